@@ -0,0 +1,234 @@
+// Microbenchmark for the premultiplied BGRA -> RGB + alpha conversion kernels,
+// and for the single-pass row conversion that writes native bitmap storage
+// (straight RGBA as on GTK, premultiplied BGRA as on MSW).
+//
+// Checks every kernel for bit-identical output against the original per-pixel
+// loop, then times them on square icons from 16px to 4096px.
+// Needs no wxWidgets or lunasvg, e.g.:
+//   g++ -O2 -std=c++17 -I.. bench_convert.cpp ../svg_pixel_convert.cpp ../svg_hit_mask.cpp -o bench_convert
+
+#include "svg_pixel_convert.h"
+#include "svg_hit_mask.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// The loop SvgImageLuna::Render used before the kernels existed.
+static void ConvertReference(const unsigned char* src, int stride, int w, int h,
+                             unsigned char* rgb, unsigned char* alpha)
+{
+    for (int y = 0; y < h; ++y)
+    {
+        const unsigned char* row = src + y * stride;
+        for (int x = 0; x < w; ++x)
+        {
+            unsigned char b = row[0];
+            unsigned char g = row[1];
+            unsigned char r = row[2];
+            unsigned char a = row[3];
+            if (a != 0)
+            {
+                r = static_cast<unsigned char>((r * 255) / a);
+                g = static_cast<unsigned char>((g * 255) / a);
+                b = static_cast<unsigned char>((b * 255) / a);
+            }
+            *rgb++ = r;
+            *rgb++ = g;
+            *rgb++ = b;
+            *alpha++ = a;
+            row += 4;
+        }
+    }
+}
+
+struct Pixels
+{
+    int w, h, stride;
+    std::vector<unsigned char> bgra;
+};
+
+// Mostly valid premultiplied pixels with some transparent and some malformed (c > a) ones.
+static Pixels MakePixels(int w, int h, unsigned seed)
+{
+    Pixels p;
+    p.w = w;
+    p.h = h;
+    p.stride = w * 4;
+    p.bgra.resize(static_cast<size_t>(p.stride) * h);
+
+    std::mt19937 rng(seed);
+    for (size_t i = 0; i < p.bgra.size(); i += 4)
+    {
+        unsigned r = rng();
+        unsigned a = (r & 7) == 0 ? 0 : (r >> 8) & 0xFF;
+        bool malformed = (r & 0xF0) == 0;
+        for (int c = 0; c < 3; ++c)
+        {
+            unsigned v = rng() & 0xFF;
+            p.bgra[i + c] = static_cast<unsigned char>(malformed || a == 0 ? v : v * a / 255);
+        }
+        p.bgra[i + 3] = static_cast<unsigned char>(a);
+    }
+    return p;
+}
+
+// Every (c, a) pair, one row per alpha value.
+static Pixels MakeExhaustive()
+{
+    Pixels p;
+    p.w = 256;
+    p.h = 256;
+    p.stride = 256 * 4;
+    p.bgra.resize(256 * 256 * 4);
+    for (int a = 0; a < 256; ++a)
+    {
+        for (int c = 0; c < 256; ++c)
+        {
+            unsigned char* px = &p.bgra[(a * 256 + c) * 4];
+            px[0] = static_cast<unsigned char>(c);
+            px[1] = static_cast<unsigned char>(255 - c);
+            px[2] = static_cast<unsigned char>(c ^ 0x5A);
+            px[3] = static_cast<unsigned char>(a);
+        }
+    }
+    return p;
+}
+
+static bool Verify(const Pixels& p, SvgPixelConvert::Kernel kernel)
+{
+    const size_t n = static_cast<size_t>(p.w) * p.h;
+    std::vector<unsigned char> rgbRef(n * 3), alphaRef(n), rgb(n * 3), alpha(n);
+    ConvertReference(p.bgra.data(), p.stride, p.w, p.h, rgbRef.data(), alphaRef.data());
+
+    SvgHitMask mask, maskRef;
+    mask.Reset(p.w, p.h);
+    maskRef.BuildFromBgra(p.bgra.data(), p.stride, p.w, p.h);
+    SvgPixelConvert::BgraToRgbAlpha(p.bgra.data(), p.stride, p.w, p.h, rgb.data(), alpha.data(), &mask, kernel);
+
+    if (rgb != rgbRef || alpha != alphaRef)
+        return false;
+    for (int y = 0; y < p.h; ++y)
+        for (int x = 0; x < p.w; ++x)
+            if (mask.Test(x, y) != maskRef.Test(x, y))
+                return false;
+    return true;
+}
+
+// Native row conversion into straight RGBA must match the planar reference too
+static bool VerifyPixelRow(const Pixels& p)
+{
+    const size_t n = static_cast<size_t>(p.w) * p.h;
+    std::vector<unsigned char> rgbRef(n * 3), alphaRef(n), rgba(n * 4);
+    ConvertReference(p.bgra.data(), p.stride, p.w, p.h, rgbRef.data(), alphaRef.data());
+
+    const SvgPixelConvert::PixelLayout layout = { 0, 1, 2, 3, false };
+    SvgHitMask mask, maskRef;
+    mask.Reset(p.w, p.h);
+    maskRef.BuildFromBgra(p.bgra.data(), p.stride, p.w, p.h);
+    for (int y = 0; y < p.h; ++y)
+        SvgPixelConvert::BgraToPixelRow(&p.bgra[y * p.stride], p.w, &rgba[y * p.w * 4], layout, mask.GetRowBits(y));
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (rgba[i * 4] != rgbRef[i * 3] || rgba[i * 4 + 1] != rgbRef[i * 3 + 1] || rgba[i * 4 + 2] != rgbRef[i * 3 + 2]
+            || rgba[i * 4 + 3] != alphaRef[i])
+            return false;
+    }
+    for (int y = 0; y < p.h; ++y)
+        for (int x = 0; x < p.w; ++x)
+            if (mask.Test(x, y) != maskRef.Test(x, y))
+                return false;
+    return true;
+}
+
+int main()
+{
+    const SvgPixelConvert::Kernel kernels[] = { SvgPixelConvert::Scalar, SvgPixelConvert::SSE2, SvgPixelConvert::AVX2 };
+    const int sizes[] = { 16, 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+
+    std::printf("best kernel: %s\n", SvgPixelConvert::GetKernelName(SvgPixelConvert::Auto));
+
+    // Correctness first: odd widths exercise the scalar tails
+    bool allOk = true;
+    const Pixels exhaustive = MakeExhaustive();
+    for (auto kernel : kernels)
+    {
+        if (!SvgPixelConvert::IsSupported(kernel))
+            continue;
+        bool ok = Verify(exhaustive, kernel);
+        for (int w = 1; w <= 67 && ok; ++w)
+            ok = Verify(MakePixels(w, 3, w), kernel);
+        std::printf("verify %-7s %s\n", SvgPixelConvert::GetKernelName(kernel), ok ? "bit-identical" : "MISMATCH");
+        allOk = allOk && ok;
+    }
+    {
+        bool ok = VerifyPixelRow(exhaustive);
+        for (int w = 1; w <= 67 && ok; ++w)
+            ok = VerifyPixelRow(MakePixels(w, 3, w));
+        std::printf("verify %-7s %s\n", "rgba", ok ? "bit-identical" : "MISMATCH");
+        allOk = allOk && ok;
+    }
+
+    std::printf("\n%6s %12s", "size", "reference");
+    for (auto kernel : kernels)
+        std::printf(" %12s", SvgPixelConvert::GetKernelName(kernel));
+    std::printf(" %12s %12s   (Mpixel/s)\n", "rgba_row", "bgra_row");
+
+    for (int size : sizes)
+    {
+        const Pixels p = MakePixels(size, size, size);
+        const size_t n = static_cast<size_t>(size) * size;
+        std::vector<unsigned char> rgb(n * 3), alpha(n);
+        SvgHitMask mask;
+
+        // roughly 64 Mpixel of work per variant
+        const int reps = static_cast<int>(std::max<size_t>(1, (size_t(64) << 20) / n));
+
+        auto time = [&](auto&& convert)
+        {
+            convert(); // warm up
+            auto t0 = std::chrono::steady_clock::now();
+            for (int i = 0; i < reps; ++i)
+                convert();
+            double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            return static_cast<double>(n) * reps / s / 1e6;
+        };
+
+        std::printf("%6d %12.1f", size, time([&] {
+            ConvertReference(p.bgra.data(), p.stride, size, size, rgb.data(), alpha.data());
+        }));
+        for (auto kernel : kernels)
+        {
+            if (!SvgPixelConvert::IsSupported(kernel))
+            {
+                std::printf(" %12s", "n/a");
+                continue;
+            }
+            std::printf(" %12.1f", time([&] {
+                mask.Reset(size, size);
+                SvgPixelConvert::BgraToRgbAlpha(p.bgra.data(), p.stride, size, size,
+                                                rgb.data(), alpha.data(), &mask, kernel);
+            }));
+        }
+
+        // Native storage: straight RGBA (GTK) and premultiplied BGRA (MSW, a copy)
+        std::vector<unsigned char> native(n * 4);
+        for (bool premultiplied : { false, true })
+        {
+            const SvgPixelConvert::PixelLayout layout = premultiplied ? SvgPixelConvert::PixelLayout{ 2, 1, 0, 3, true }
+                                                                      : SvgPixelConvert::PixelLayout{ 0, 1, 2, 3, false };
+            std::printf(" %12.1f", time([&] {
+                mask.Reset(size, size);
+                for (int y = 0; y < size; ++y)
+                    SvgPixelConvert::BgraToPixelRow(&p.bgra[y * p.stride], size, &native[y * size * 4], layout,
+                                                    mask.GetRowBits(y));
+            }));
+        }
+        std::printf("\n");
+    }
+
+    return allOk ? 0 : 1;
+}
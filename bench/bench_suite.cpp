@@ -0,0 +1,863 @@
+// Benchmark suite for the hot paths: file loading, parse, rasterize, convert,
+// render, hit-test, a full offscreen canvas paint and startup to first frame.
+// Results are printed as JSON so runs can be diffed between releases.
+//
+// Scenes are built from the icons in assets/ plus generated SVGs of growing
+// complexity. Parsing, rasterizing and converting need no display. Render,
+// hit-test and paint need the GUI toolkit; without a display they are listed
+// under "skipped" (run under xvfb-run to include them). Correctness checks run
+// alongside: those that fail are listed under "failed" and the exit status is 1.
+//
+//   bench_suite [--assets DIR] [--items N] [--repeat N] [--out FILE]
+//
+// Linux build, from the repository root:
+//   g++ -O2 -std=c++17 -I. -Iliblunasvg/include/lunasvg bench/bench_suite.cpp svg_*.cpp
+//       `wx-config --cflags --libs base,core` -Lliblunasvg/lib -llunasvg -o bench_suite
+
+#include "svg_canvas.h"
+#include "svg_disk_cache.h"
+#include "svg_document_store.h"
+#include "svg_image_luna.h"
+#include "svg_mapped_file.h"
+#include "svg_pixel_convert.h"
+#include "svg_render_buffer.h"
+#include "svg_scene_snapshot.h"
+
+#include <wx/app.h>
+#include <wx/version.h>
+#include <wx/frame.h>
+#include <wx/dcmemory.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// The GUI half needs a wxApp to initialize the toolkit; benchmarks run from main()
+class BenchApp : public wxApp
+{
+public:
+    bool OnInit() override { return true; }
+};
+
+wxIMPLEMENT_APP_NO_MAIN(BenchApp);
+
+// Exposes the protected pieces the benchmarks drive directly
+class BenchCanvas : public SvgCanvas
+{
+public:
+    explicit BenchCanvas(wxWindow* parent) : SvgCanvas(parent) {}
+
+    using SvgCanvas::HasPendingRenders;
+    using SvgCanvas::HitTest;
+    using SvgCanvas::InsertItem;
+    using SvgCanvas::PaintArea;
+    using SvgCanvas::SettleZoom;
+};
+
+struct Options
+{
+    std::string assets = "assets";
+    int items = 1000;
+    int repeat = 5;
+    std::string out; // stdout if empty
+};
+
+struct Source
+{
+    std::string name;
+    std::string path;
+    std::string text;
+};
+
+struct Result
+{
+    std::string name;
+    int ops;                 // operations per timed run
+    size_t bytes;            // input bytes per timed run, 0 if not a throughput figure
+    std::vector<double> ms;  // one sample per run
+    double buffersPerOp = -1;     // render buffer pool acquires per operation in the last run, -1 if not tracked
+    double allocationsPerOp = -1; // of those, newly allocated
+};
+
+struct Report
+{
+    std::vector<Result> results;
+    std::vector<std::pair<std::string, std::string>> skipped; // name, reason
+    std::vector<std::string> failed;                          // correctness checks that did not hold
+};
+
+// Time 'repeat' runs of f, each doing 'ops' operations
+static Result Measure(const std::string& name, int ops, int repeat, const std::function<void()>& f)
+{
+    Result result;
+    result.name = name;
+    result.ops = ops;
+    result.bytes = 0;
+    for (int i = 0; i < repeat; ++i)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        const auto stop = std::chrono::steady_clock::now();
+        result.ms.push_back(std::chrono::duration<double, std::milli>(stop - start).count());
+    }
+    return result;
+}
+
+// A busy drawing: gradients, curved paths, strokes, groups with transforms and opacity
+static std::string MakeComplexSvg(int shapes, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> coord(0.0, 512.0);
+    std::uniform_int_distribution<int> channel(0, 255);
+
+    std::ostringstream svg;
+    svg << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"512\" height=\"512\" viewBox=\"0 0 512 512\">\n"
+        << "<defs>\n";
+    for (int i = 0; i < 8; ++i)
+    {
+        svg << "<linearGradient id=\"g" << i << "\" x1=\"0\" y1=\"0\" x2=\"1\" y2=\"1\">"
+            << "<stop offset=\"0\" stop-color=\"rgb(" << channel(rng) << "," << channel(rng) << "," << channel(rng) << ")\"/>"
+            << "<stop offset=\"1\" stop-color=\"rgb(" << channel(rng) << "," << channel(rng) << "," << channel(rng) << ")\"/>"
+            << "</linearGradient>\n";
+    }
+    svg << "</defs>\n";
+
+    for (int i = 0; i < shapes; ++i)
+    {
+        if (i % 16 == 0)
+        {
+            if (i) svg << "</g>\n";
+            svg << "<g opacity=\"0.9\" transform=\"rotate(" << (i * 7) % 360 << " 256 256)\">\n";
+        }
+
+        if (i % 3 == 0)
+        {
+            svg << "<circle cx=\"" << coord(rng) << "\" cy=\"" << coord(rng) << "\" r=\"" << coord(rng) / 16
+                << "\" fill=\"url(#g" << i % 8 << ")\" stroke=\"black\" stroke-width=\"1.5\"/>\n";
+        }
+        else
+        {
+            svg << "<path d=\"M" << coord(rng) << " " << coord(rng);
+            for (int k = 0; k < 4; ++k)
+                svg << " C" << coord(rng) << " " << coord(rng) << " " << coord(rng) << " " << coord(rng)
+                    << " " << coord(rng) << " " << coord(rng);
+            svg << " Z\" fill=\"url(#g" << i % 8 << ")\" fill-opacity=\"0.6\" stroke=\"rgb("
+                << channel(rng) << "," << channel(rng) << "," << channel(rng) << ")\" stroke-width=\"2\"/>\n";
+        }
+    }
+    if (shapes > 0)
+        svg << "</g>\n";
+    svg << "</svg>\n";
+    return svg.str();
+}
+
+static bool ReadFile(const std::string& path, std::string& text)
+{
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs)
+        return false;
+    text.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static std::vector<Source> CollectSources(const Options& options, const fs::path& tempDir)
+{
+    std::vector<Source> sources;
+
+    std::error_code ec;
+    std::vector<fs::path> icons;
+    for (const auto& entry : fs::directory_iterator(options.assets, ec))
+    {
+        if (entry.path().extension() == ".svg")
+            icons.push_back(entry.path());
+    }
+    std::sort(icons.begin(), icons.end());
+
+    for (const auto& path : icons)
+    {
+        Source source;
+        source.name = path.filename().string();
+        source.path = path.string();
+        if (ReadFile(source.path, source.text))
+            sources.push_back(source);
+    }
+
+    const int complexity[] = { 50, 500, 5000 };
+    for (int shapes : complexity)
+    {
+        Source source;
+        source.name = "generated_" + std::to_string(shapes) + ".svg";
+        source.path = (tempDir / source.name).string();
+        source.text = MakeComplexSvg(shapes, static_cast<unsigned>(shapes));
+        std::ofstream(source.path, std::ios::binary) << source.text;
+        sources.push_back(source);
+    }
+    return sources;
+}
+
+// Parse, rasterize and convert: wx image code only, no toolkit needed
+static void RunHeadless(const Options& options, const std::vector<Source>& sources, Report& report)
+{
+    const int sizes[] = { 32, 128, 512, 2048 };
+
+    for (const Source& source : sources)
+    {
+        // A fresh parse every time, bypassing the document store
+        report.results.push_back(Measure("parse/" + source.name, 1, options.repeat, [&]()
+        {
+            SvgDocumentStore::CreatePrivate(source.text);
+        }));
+
+        auto doc = SvgDocumentStore::CreatePrivate(source.text);
+        if (!doc)
+            continue;
+
+        for (int size : sizes)
+        {
+            const std::string suffix = source.name + "/" + std::to_string(size);
+            report.results.push_back(Measure("rasterize/" + suffix, 1, options.repeat, [&]()
+            {
+                // The worker half of a render, then the UI thread's single pass into
+                // native pixels (straight RGBA, as on GTK) and the hit mask
+                SvgRenderBuffer buffer;
+                if (!SvgImageLuna::Rasterize(*doc->document, size, size, -1, -1, buffer))
+                    return;
+                const lunasvg::Bitmap& pixels = buffer.GetBitmap();
+                SvgRenderBufferPool::Lease native = SvgRenderBufferPool::Get().Acquire(static_cast<size_t>(size) * size * 4);
+                SvgHitMask mask;
+                mask.Reset(size, size);
+                const SvgPixelConvert::PixelLayout layout = { 0, 1, 2, 3, false };
+                for (int row = 0; row < size; ++row)
+                    SvgPixelConvert::BgraToPixelRow(pixels.data() + row * pixels.stride(), size,
+                                                    native.GetData() + static_cast<size_t>(row) * size * 4,
+                                                    layout, mask.GetRowBits(row));
+            }));
+        }
+    }
+
+    // Getting the largest source into memory: copying it through a stream as
+    // LoadFromFile used to, mapping it as it does now. Both hash it, as interning
+    // does, so every page is actually read.
+    const Source* largest = &sources.front();
+    for (const Source& source : sources)
+        if (source.text.size() > largest->text.size())
+            largest = &source;
+
+    Result read = Measure("read/istreambuf/" + largest->name, 1, options.repeat, [&]()
+    {
+        std::string text;
+        ReadFile(largest->path, text);
+        SvgDocumentStore::Hash(text.data(), text.size());
+    });
+    read.bytes = largest->text.size();
+    report.results.push_back(read);
+
+    read = Measure("read/mapped/" + largest->name, 1, options.repeat, [&]()
+    {
+        SvgMappedFile file;
+        if (file.Open(largest->path))
+            SvgDocumentStore::Hash(file.GetData(), file.GetSize());
+    });
+    read.bytes = largest->text.size();
+    report.results.push_back(read);
+
+    // Whole load of the largest source, parse included, with and without the source text kept
+    const SvgDocumentStore::SourcePolicy policies[] = { SvgDocumentStore::KeepSource, SvgDocumentStore::ReleaseReloadableSource };
+    for (auto policy : policies)
+    {
+        SvgDocumentStore::Get().SetSourcePolicy(policy);
+        Result load = Measure(std::string(policy == SvgDocumentStore::KeepSource ? "load_file/keep/" : "load_file/release/")
+                              + largest->name, 1, options.repeat, [&]()
+        {
+            SvgImageLuna image;
+            image.LoadFromFile(largest->path);
+        });
+        load.bytes = largest->text.size();
+        report.results.push_back(load);
+    }
+    SvgDocumentStore::Get().SetSourcePolicy(SvgDocumentStore::KeepSource);
+
+    // N items cycling through the sources: file read + interning + the parses it cannot avoid
+    report.results.push_back(Measure("load_scene/" + std::to_string(options.items), options.items, options.repeat, [&]()
+    {
+        std::vector<std::unique_ptr<SvgImageLuna>> images;
+        images.reserve(options.items);
+        for (int i = 0; i < options.items; ++i)
+        {
+            images.emplace_back(new SvgImageLuna());
+            images.back()->LoadFromFile(sources[i % sources.size()].path);
+        }
+    }));
+
+    // Scene file of 50k items over the sources: the format alone, no canvas
+    {
+        const int count = 50000;
+        SvgSceneSnapshot snapshot;
+        for (const Source& source : sources)
+        {
+            snapshot.sources.push_back(SvgSceneSnapshot::Source{ std::make_shared<std::string>(source.text), source.path });
+            snapshot.documents.push_back(SvgSceneSnapshot::Document{ static_cast<unsigned>(snapshot.documents.size()), {} });
+        }
+        for (int i = 0; i < count; ++i)
+        {
+            SvgSceneSnapshot::Item item = { (i % 250) * 100, (i / 250) * 120, 96, 96, true,
+                                            "item " + std::to_string(i), static_cast<unsigned>(i % sources.size()) };
+            snapshot.items.push_back(item);
+        }
+
+        const std::string path = (fs::temp_directory_path() / "svg_canvas_bench_scene.svgscene").string();
+        report.results.push_back(Measure("snapshot_save/" + std::to_string(count), count, options.repeat, [&]()
+        {
+            snapshot.Save(path);
+        }));
+        report.results.push_back(Measure("snapshot_load/" + std::to_string(count), count, options.repeat, [&]()
+        {
+            SvgSceneSnapshot loaded;
+            loaded.Load(path);
+        }));
+        std::error_code ec;
+        fs::remove(path, ec);
+    }
+
+    // BGRA -> RGB + alpha on real lunasvg output, every kernel this CPU runs
+    auto doc = SvgDocumentStore::CreatePrivate(sources.back().text);
+    if (!doc)
+        return;
+
+    const SvgPixelConvert::Kernel kernels[] = { SvgPixelConvert::Scalar, SvgPixelConvert::SSE2, SvgPixelConvert::AVX2 };
+    for (int size : sizes)
+    {
+        lunasvg::Bitmap bitmap = doc->document->renderToBitmap(size, size);
+        if (!bitmap.valid())
+            continue;
+
+        std::vector<unsigned char> rgb(static_cast<size_t>(size) * size * 3);
+        std::vector<unsigned char> alpha(static_cast<size_t>(size) * size);
+        SvgHitMask mask;
+        mask.Reset(size, size);
+
+        for (SvgPixelConvert::Kernel kernel : kernels)
+        {
+            if (!SvgPixelConvert::IsSupported(kernel))
+                continue;
+
+            const std::string name = std::string("convert/") + SvgPixelConvert::GetKernelName(kernel) + "/" + std::to_string(size);
+            const int ops = std::max(1, (1 << 22) / (size * size)); // ~4 Mpx per run
+            report.results.push_back(Measure(name, ops, options.repeat, [&]()
+            {
+                for (int i = 0; i < ops; ++i)
+                    SvgPixelConvert::BgraToRgbAlpha(bitmap.data(), bitmap.stride(), size, size,
+                                                    rgb.data(), alpha.data(), &mask, kernel);
+            }));
+        }
+    }
+}
+
+// Render, hit-test and paint: needs the toolkit initialized
+// Startup to first full frame on a scene of distinct documents: load every file
+// and paint the viewport, through a disk raster cache that is empty (cold) or
+// filled by the previous run (warm). Rendering in paint, and as the app ships:
+// async, where the frame is complete once every queued render has been drained
+// and the viewport painted again.
+static void MeasureFirstFrame(const Options& options, const fs::path& tempDir, Report& report)
+{
+    const fs::path sceneDir = tempDir / "first_frame";
+    std::error_code ec;
+    fs::create_directories(sceneDir, ec);
+
+    const wxSize viewport(1280, 800);
+    const int columns = std::max(1, static_cast<int>(std::sqrt(double(options.items))));
+    const int pitch = std::max(1, std::min(viewport.x, viewport.y) / columns);
+    std::vector<SvgCanvas::FileEntry> entries(options.items);
+    for (int i = 0; i < options.items; ++i)
+    {
+        entries[i].path = (sceneDir / ("item_" + std::to_string(i) + ".svg")).string();
+        std::ofstream(entries[i].path, std::ios::binary) << MakeComplexSvg(50, static_cast<unsigned>(i));
+        entries[i].pos = wxPoint((i % columns) * pitch, (i / columns) * pitch);
+        entries[i].baseSize = wxSize(96, 96);
+    }
+
+    auto diskCache = std::make_shared<SvgDiskCache>((tempDir / "raster_cache").string(), 0);
+    const std::string items = std::to_string(options.items);
+
+    auto firstFrame = [&](bool async)
+    {
+        wxFrame* frame = new wxFrame(nullptr, wxID_ANY, "bench_suite", wxDefaultPosition, viewport);
+        BenchCanvas* canvas = new BenchCanvas(frame);
+        canvas->SetSize(viewport);
+        canvas->SetAsyncRender(async);
+        canvas->SetDiskCache(diskCache);
+        canvas->AddSvgFiles(entries);
+
+        wxBitmap target(viewport.x, viewport.y, 32);
+        wxMemoryDC dc(target);
+        canvas->PaintArea(dc, wxRect(wxPoint(0, 0), viewport));
+        if (async)
+        {
+            // Results come back through CallAfter: run those events until all have landed
+            while (canvas->HasPendingRenders())
+            {
+                wxTheApp->ProcessPendingEvents();
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+            canvas->PaintArea(dc, wxRect(wxPoint(0, 0), viewport));
+        }
+        dc.SelectObject(wxNullBitmap);
+
+        // Release the documents now, not at the next idle time, so no run reuses another's parse
+        canvas->Clear();
+        frame->Destroy();
+    };
+
+    for (bool async : { false, true })
+    {
+        const std::string mode = async ? "first_frame_async/" : "first_frame/";
+        report.results.push_back(Measure(mode + "disk_cold/" + items, 1, options.repeat, [&]()
+        {
+            diskCache->Clear();
+            firstFrame(async);
+        }));
+        report.results.push_back(Measure(mode + "disk_warm/" + items, 1, options.repeat, [&]()
+        {
+            firstFrame(async);
+        }));
+    }
+
+    diskCache->Clear();
+    fs::remove_all(sceneDir, ec);
+}
+
+// Atlas slots dropped behind the bitmap cache's back must be rendered again:
+// paint at one size, at another (whose slots replace the first ones), then at
+// the first size again, and expect the same pixels as the first time
+static bool CheckAtlasRedraw(BenchCanvas* canvas, const wxRect& area)
+{
+    wxBitmap target(area.width, area.height, 32);
+    wxMemoryDC dc(target);
+    auto paint = [&](double zoom)
+    {
+        canvas->SetZoom(zoom);
+        canvas->SettleZoom();
+        dc.SetBackground(*wxWHITE_BRUSH);
+        dc.Clear();
+        canvas->PaintArea(dc, area);
+    };
+
+    canvas->SetAtlasMode(true);
+    paint(0.5);
+    dc.SelectObject(wxNullBitmap);
+    const wxImage before = target.ConvertToImage();
+
+    dc.SelectObject(target);
+    paint(0.625);
+    paint(0.5);
+    dc.SelectObject(wxNullBitmap);
+    const wxImage after = target.ConvertToImage();
+    canvas->SetAtlasMode(false);
+
+    return before.IsOk() && after.IsOk()
+        && memcmp(before.GetData(), after.GetData(), static_cast<size_t>(area.width) * area.height * 3) == 0;
+}
+
+// An item restored from a source whose text was released must still be saved:
+// its text is read back from the file, and the scene reloads with it
+static bool CheckSceneReleasedSource(wxWindow* parent, const Source& source, const fs::path& tempDir)
+{
+    BenchCanvas* canvas = new BenchCanvas(parent);
+    auto deferred = std::make_shared<SvgDeferredSource>();
+    deferred->path = source.path; // no text
+    std::unique_ptr<SvgItem> item(new SvgItem);
+    item->svg.SetDeferredSource(deferred);
+    canvas->InsertItem(std::move(item), wxPoint(0, 0), wxSize(96, 96), "released");
+
+    const std::string scenePath = (tempDir / "released.svgscene").string();
+    SvgSceneSnapshot saved;
+    const bool ok = canvas->SaveScene(scenePath) && canvas->LoadScene(scenePath) && saved.Load(scenePath)
+        && saved.items.size() == 1 && saved.sources.size() == 1
+        && saved.sources[0].text && *saved.sources[0].text == source.text;
+    canvas->Destroy();
+    return ok;
+}
+
+static void RunGui(const Options& options, const std::vector<Source>& sources, const fs::path& tempDir, Report& report)
+{
+    const int sizes[] = { 32, 128, 512, 2048 };
+
+    for (const Source& source : sources)
+    {
+        SvgImageLuna image;
+        if (!image.LoadFromString(source.text))
+            continue;
+
+        for (int size : sizes)
+        {
+            report.results.push_back(Measure("render/" + source.name + "/" + std::to_string(size), 1, options.repeat, [&]()
+            {
+                image.MarkDirty(); // defeat the cache
+                image.Render(size, size, 1.0);
+            }));
+        }
+    }
+
+    const wxSize viewport(1280, 800);
+    wxFrame* frame = new wxFrame(nullptr, wxID_ANY, "bench_suite", wxDefaultPosition, viewport);
+    BenchCanvas* canvas = new BenchCanvas(frame);
+    canvas->SetSize(viewport);
+
+    // Grid scene of 96px icons, all of them inside the painted area at zoom 1
+    const int columns = std::max(1, static_cast<int>(std::sqrt(double(options.items))));
+    const int pitch = std::max(1, std::min(viewport.x, viewport.y) / columns);
+    std::vector<SvgCanvas::FileEntry> entries(options.items);
+    for (int i = 0; i < options.items; ++i)
+    {
+        entries[i].path = sources[i % sources.size()].path;
+        entries[i].pos = wxPoint((i % columns) * pitch, (i / columns) * pitch);
+        entries[i].baseSize = wxSize(96, 96);
+        entries[i].label = wxString::Format("item %d", i);
+    }
+    report.results.push_back(Measure("add_svg_files/" + std::to_string(options.items), options.items, 1, [&]()
+    {
+        canvas->AddSvgFiles(entries);
+    }));
+
+    wxBitmap target(viewport.x, viewport.y, 32);
+    wxMemoryDC dc(target);
+    const wxRect area(wxPoint(0, 0), viewport);
+    const std::string items = std::to_string(options.items);
+
+    report.results.push_back(Measure("paint_cold/" + items, 1, 1, [&]()
+    {
+        canvas->PaintArea(dc, area);
+    }));
+    report.results.push_back(Measure("paint_warm/" + items, 1, options.repeat, [&]()
+    {
+        canvas->PaintArea(dc, area);
+    }));
+
+    canvas->SetZoom(2.0);
+    canvas->SettleZoom();
+    report.results.push_back(Measure("paint_zoom2_cold/" + items, 1, 1, [&]()
+    {
+        canvas->PaintArea(dc, area);
+    }));
+
+    // At half size the icons fit the atlas: one blit source per page instead of a bitmap per item
+    canvas->SetZoom(0.5);
+    canvas->SettleZoom();
+    canvas->PaintArea(dc, area);
+    report.results.push_back(Measure("paint_small_direct/" + items, 1, options.repeat, [&]()
+    {
+        canvas->PaintArea(dc, area);
+    }));
+    canvas->SetAtlasMode(true);
+    canvas->PaintArea(dc, area); // moves the renders into the atlas
+    report.results.push_back(Measure("paint_small_atlas/" + items, 1, options.repeat, [&]()
+    {
+        canvas->PaintArea(dc, area);
+    }));
+    canvas->SetAtlasMode(false);
+    if (!CheckAtlasRedraw(canvas, wxRect(0, 0, 256, 256)))
+        report.failed.push_back("atlas_redraw: items evicted from the atlas were not rendered again");
+    if (!CheckSceneReleasedSource(frame, sources.front(), tempDir))
+        report.failed.push_back("scene_released_source: an item without its source text was not saved");
+
+    // Zooming through more levels than an item caches, so every frame re-renders
+    // every item: once the first pass has filled the buffer pool, rendering
+    // should allocate no pixel memory at all
+    const double zooms[] = { 0.75, 0.875, 1.0, 1.125, 1.25, 1.375, 1.5, 1.625 };
+    const int zoomCount = static_cast<int>(sizeof(zooms) / sizeof(zooms[0]));
+    unsigned long long acquires = 0;
+    unsigned long long allocations = 0;
+    Result zoomCycle = Measure("paint_zoom_cycle/" + items, zoomCount, options.repeat, [&]()
+    {
+        acquires = 0;
+        allocations = 0;
+        for (double zoom : zooms)
+        {
+            canvas->SetZoom(zoom);
+            canvas->SettleZoom();
+            canvas->PaintArea(dc, area);
+            acquires += canvas->GetFrameBufferStats().acquires;
+            allocations += canvas->GetFrameBufferStats().allocations;
+        }
+    });
+    zoomCycle.buffersPerOp = static_cast<double>(acquires) / zoomCount;
+    zoomCycle.allocationsPerOp = static_cast<double>(allocations) / zoomCount;
+    report.results.push_back(zoomCycle);
+
+    // Wheel steps within one gesture: each frame only scales the renders items
+    // already have, so it should take no render buffers, whatever the scene size
+    canvas->SetZoom(1.0);
+    canvas->SettleZoom();
+    canvas->PaintArea(dc, area);
+    const int gestureSteps = 10;
+    Result zoomGesture = Measure("paint_zoom_gesture/" + items, gestureSteps, options.repeat, [&]()
+    {
+        acquires = 0;
+        allocations = 0;
+        double zoom = 1.0;
+        for (int step = 0; step < gestureSteps; ++step)
+        {
+            zoom *= 1.1;
+            canvas->SetZoom(zoom);
+            canvas->PaintArea(dc, area);
+            acquires += canvas->GetFrameBufferStats().acquires;
+            allocations += canvas->GetFrameBufferStats().allocations;
+        }
+        canvas->SetZoom(1.0); // still the same gesture: the next repeat starts where this one did
+    });
+    zoomGesture.buffersPerOp = static_cast<double>(acquires) / gestureSteps;
+    zoomGesture.allocationsPerOp = static_cast<double>(allocations) / gestureSteps;
+    report.results.push_back(zoomGesture);
+
+    canvas->SetZoom(1.0);
+    canvas->SettleZoom();
+
+    // Pick points all over the scene
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> px(0, columns * pitch);
+    std::vector<wxPoint> points(10000);
+    for (wxPoint& pt : points)
+        pt = wxPoint(px(rng), px(rng));
+
+    report.results.push_back(Measure("hit_test/" + items, static_cast<int>(points.size()), options.repeat, [&]()
+    {
+        for (const wxPoint& pt : points)
+            canvas->HitTest(pt);
+    }));
+
+    // Save the scene and restore it: restoring parses nothing until paint
+    const std::string scenePath = (tempDir / "scene.svgscene").string();
+    report.results.push_back(Measure("save_scene/" + items, options.items, 1, [&]()
+    {
+        canvas->SaveScene(scenePath);
+    }));
+    report.results.push_back(Measure("restore_scene/" + items, options.items, options.repeat, [&]()
+    {
+        canvas->LoadScene(scenePath);
+    }));
+    report.results.push_back(Measure("paint_after_restore/" + items, 1, 1, [&]()
+    {
+        canvas->PaintArea(dc, area);
+    }));
+
+    // Overview of a large scene zoomed out to the level-of-detail stand-ins:
+    // colour proxies at minimum zoom, shared thumbnails a little closer
+    const int overviewItems = 50000;
+    const int overviewColumns = static_cast<int>(std::sqrt(double(overviewItems)));
+    std::vector<SvgCanvas::FileEntry> overviewEntries(overviewItems);
+    for (int i = 0; i < overviewItems; ++i)
+    {
+        overviewEntries[i].path = sources[i % sources.size()].path;
+        overviewEntries[i].pos = wxPoint((i % overviewColumns) * 100, (i / overviewColumns) * 100);
+        overviewEntries[i].baseSize = wxSize(96, 96);
+        overviewEntries[i].label = wxString::Format("item %d", i);
+    }
+    BenchCanvas* overview = new BenchCanvas(frame);
+    overview->SetSize(viewport);
+    overview->AddSvgFiles(overviewEntries);
+
+    const std::string overviewCount = std::to_string(overviewItems);
+    const std::pair<const char*, double> levels[] = { { "paint_overview_proxy/", 0.05 }, { "paint_overview_thumbnail/", 0.2 } };
+    for (const auto& level : levels)
+    {
+        overview->SetZoom(level.second);
+        overview->SettleZoom();
+        overview->PaintArea(dc, area); // thumbnails and colours, once per document
+        report.results.push_back(Measure(level.first + overviewCount, 1, options.repeat, [&]()
+        {
+            overview->PaintArea(dc, area);
+        }));
+    }
+
+    // One pan step (a scroll unit) over the thumbnail overview: the rest of the
+    // view is moved on screen, only the exposed strip is painted
+    const wxRect strip(area.GetRight() + 1 - 10, area.y, 10, area.height);
+    report.results.push_back(Measure("paint_pan_strip/" + overviewCount, 1, options.repeat, [&]()
+    {
+        overview->PaintArea(dc, strip);
+    }));
+
+    // Settling a zoom: every item's bounds recomputed, the index and scene extent rebuilt
+    double settleZoom = 0.2;
+    report.results.push_back(Measure("zoom_settle/" + overviewCount, 1, options.repeat, [&]()
+    {
+        settleZoom = settleZoom == 0.2 ? 0.25 : 0.2;
+        overview->SetZoom(settleZoom);
+        overview->SettleZoom();
+    }));
+
+    dc.SelectObject(wxNullBitmap);
+    frame->Destroy();
+
+    MeasureFirstFrame(options, tempDir, report);
+}
+
+static std::string JsonEscape(const std::string& text)
+{
+    std::string out;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+static void WriteJson(FILE* out, const Options& options, const Report& report)
+{
+    fprintf(out, "{\n");
+    fprintf(out, "  \"suite\": \"svg_canvas\",\n");
+    fprintf(out, "  \"format\": 1,\n");
+    // Library versions, so results from different toolchains are never compared unawares
+#ifdef LUNASVG_VERSION_STRING
+    const char* lunasvgVersion = LUNASVG_VERSION_STRING;
+#else
+    const char* lunasvgVersion = "unknown";
+#endif
+    fprintf(out, "  \"config\": { \"items\": %d, \"repeat\": %d, \"convert_kernel\": \"%s\", \"threads\": %u, "
+                 "\"wx\": \"%d.%d.%d\", \"lunasvg\": \"%s\" },\n",
+            options.items, options.repeat,
+            SvgPixelConvert::GetKernelName(SvgPixelConvert::GetBestKernel()),
+            std::thread::hardware_concurrency(),
+            wxMAJOR_VERSION, wxMINOR_VERSION, wxRELEASE_NUMBER, lunasvgVersion);
+
+    fprintf(out, "  \"results\": [\n");
+    for (size_t i = 0; i < report.results.size(); ++i)
+    {
+        const Result& r = report.results[i];
+        std::vector<double> sorted = r.ms;
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0;
+        for (double ms : sorted)
+            sum += ms;
+        const double median = sorted[sorted.size() / 2];
+
+        std::string throughput;
+        if (r.bytes && median > 0)
+        {
+            char text[96];
+            snprintf(text, sizeof(text), ", \"bytes\": %zu, \"mb_per_s\": %.1f",
+                     r.bytes, r.bytes / (1024.0 * 1024.0) / (median / 1000.0));
+            throughput = text;
+        }
+        if (r.buffersPerOp >= 0)
+        {
+            char text[96];
+            snprintf(text, sizeof(text), ", \"buffers_per_op\": %.1f, \"buffer_allocations_per_op\": %.1f",
+                     r.buffersPerOp, r.allocationsPerOp);
+            throughput += text;
+        }
+
+        fprintf(out, "    { \"name\": \"%s\", \"ops\": %d, \"runs\": %d, \"min_ms\": %.4f, \"median_ms\": %.4f, "
+                     "\"mean_ms\": %.4f, \"median_us_per_op\": %.4f%s }%s\n",
+                JsonEscape(r.name).c_str(), r.ops, static_cast<int>(sorted.size()),
+                sorted.front(), median, sum / sorted.size(), median * 1000.0 / r.ops, throughput.c_str(),
+                i + 1 < report.results.size() ? "," : "");
+    }
+    fprintf(out, "  ],\n");
+
+    fprintf(out, "  \"skipped\": [\n");
+    for (size_t i = 0; i < report.skipped.size(); ++i)
+    {
+        fprintf(out, "    { \"name\": \"%s\", \"reason\": \"%s\" }%s\n",
+                JsonEscape(report.skipped[i].first).c_str(), JsonEscape(report.skipped[i].second).c_str(),
+                i + 1 < report.skipped.size() ? "," : "");
+    }
+    fprintf(out, "  ],\n");
+
+    fprintf(out, "  \"failed\": [\n");
+    for (size_t i = 0; i < report.failed.size(); ++i)
+    {
+        fprintf(out, "    \"%s\"%s\n", JsonEscape(report.failed[i]).c_str(),
+                i + 1 < report.failed.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
+}
+
+static bool ParseOptions(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--assets") && hasValue)
+            options.assets = argv[++i];
+        else if (!strcmp(argv[i], "--items") && hasValue)
+            options.items = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--repeat") && hasValue)
+            options.repeat = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--out") && hasValue)
+            options.out = argv[++i];
+        else
+        {
+            fprintf(stderr, "usage: %s [--assets DIR] [--items N] [--repeat N] [--out FILE]\n", argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!ParseOptions(argc, argv, options))
+        return 2;
+
+    std::error_code ec;
+    const fs::path tempDir = fs::temp_directory_path(ec) / "svg_canvas_bench";
+    fs::create_directories(tempDir, ec);
+
+    const std::vector<Source> sources = CollectSources(options, tempDir);
+    if (sources.empty())
+    {
+        fprintf(stderr, "no SVG sources\n");
+        return 1;
+    }
+
+    Report report;
+    RunHeadless(options, sources, report);
+
+    // The toolkit refuses to start without a display; record that instead of failing
+    int wxArgc = 1;
+    if (wxEntryStart(wxArgc, argv))
+    {
+        RunGui(options, sources, tempDir, report);
+        wxEntryCleanup();
+    }
+    else
+    {
+        for (const char* name : { "render", "paint", "hit_test" })
+            report.skipped.push_back(std::make_pair(std::string(name), std::string("GUI toolkit unavailable (no display?)")));
+    }
+
+    fs::remove_all(tempDir, ec);
+
+    FILE* out = options.out.empty() ? stdout : fopen(options.out.c_str(), "w");
+    if (!out)
+    {
+        fprintf(stderr, "cannot write %s\n", options.out.c_str());
+        return 1;
+    }
+    WriteJson(out, options, report);
+    if (out != stdout)
+        fclose(out);
+
+    for (const std::string& failure : report.failed)
+        fprintf(stderr, "FAILED %s\n", failure.c_str());
+    return report.failed.empty() ? 0 : 1;
+}
@@ -1,4 +1,5 @@
 #include <wx/wx.h>
+#include <wx/stdpaths.h>
 #include "svg_canvas.h"
 
 // Main frame
@@ -9,6 +10,11 @@ public:
         : wxFrame(nullptr, wxID_ANY, "SVG Canvas Example", wxDefaultPosition, wxSize(900, 700))
     {
         m_canvas = new SvgCanvas(this);
+        m_canvas->SetAsyncRender(true);
+
+        // Keep renders between runs, so the next start skips rasterizing unchanged files
+        m_canvas->SetDiskCache(std::make_shared<SvgDiskCache>(
+            (wxStandardPaths::Get().GetUserDataDir() + wxFILE_SEP_PATH + "raster_cache").ToStdString()));
 
         // Example: add several SVG files (replace paths with your files)
         // We'll place them vertically with some spacing
@@ -28,10 +34,16 @@ public:
 
         enum
         {
-            ID_MODIFY_SVG_COLOR = wxID_HIGHEST + 1,
-            ID_MODIFY_SVG_TEXT  = wxID_HIGHEST + 2
+            ID_MODIFY_SVG_COLOR    = wxID_HIGHEST + 1,
+            ID_MODIFY_SVG_TEXT     = wxID_HIGHEST + 2,
+            ID_PROFILER_OVERLAY    = wxID_HIGHEST + 3,
+            ID_RECORD_TRACE        = wxID_HIGHEST + 4
         };
 
+        wxMenu* menuFile = new wxMenu;
+        menuFile->Append(wxID_OPEN, "&Open Scene...\tCtrl+O", "Replace the canvas with a saved scene");
+        menuFile->Append(wxID_SAVEAS, "&Save Scene...\tCtrl+S", "Save every item and its edits to a scene file");
+
         wxMenu* menuEdit = new wxMenu;
         menuEdit->Append(ID_MODIFY_SVG_COLOR,
                          "Modify SVG Color...",
@@ -40,17 +52,33 @@ public:
                          "Modify SVG Text...",
                          "Change the text content of the selected SVG");
 
+        wxMenu* menuView = new wxMenu;
+        menuView->AppendCheckItem(ID_PROFILER_OVERLAY, "Profiler &Overlay\tF11",
+                                  "Show paint time, item counts and cache hit rate of each frame");
+        menuView->AppendCheckItem(ID_RECORD_TRACE, "&Record Trace",
+                                  "Record a Chrome trace of painting and rendering; uncheck to save it");
+
         wxMenuBar* menuBar = new wxMenuBar;
+        menuBar->Append(menuFile, "&File");
         menuBar->Append(menuEdit, "&Edit");
+        menuBar->Append(menuView, "&View");
         SetMenuBar(menuBar);
 
         Bind(wxEVT_MENU, &MainFrame::OnChangeSvgColor, this, ID_MODIFY_SVG_COLOR);
         Bind(wxEVT_MENU, &MainFrame::OnChangeSvgText, this, ID_MODIFY_SVG_TEXT);
+        Bind(wxEVT_MENU, &MainFrame::OnOpenScene, this, wxID_OPEN);
+        Bind(wxEVT_MENU, &MainFrame::OnSaveScene, this, wxID_SAVEAS);
+        Bind(wxEVT_MENU, &MainFrame::OnProfilerOverlay, this, ID_PROFILER_OVERLAY);
+        Bind(wxEVT_MENU, &MainFrame::OnRecordTrace, this, ID_RECORD_TRACE);
 
     }
 
     void OnChangeSvgColor(wxCommandEvent&);
     void OnChangeSvgText(wxCommandEvent&);
+    void OnOpenScene(wxCommandEvent&);
+    void OnSaveScene(wxCommandEvent&);
+    void OnProfilerOverlay(wxCommandEvent&);
+    void OnRecordTrace(wxCommandEvent&);
 
 private:
     SvgCanvas* m_canvas;
@@ -60,8 +88,9 @@ private:
 void MainFrame::OnChangeSvgColor(wxCommandEvent&)
 {
     // get currently selected SVG item
-    auto hit = m_canvas->GetSelectedSvg();
-    if (!hit)
+    SvgItemHandle hit = m_canvas->GetSelectedItem();
+    SvgItem* item = m_canvas->GetItem(hit);
+    if (!item)
     {
         wxMessageBox("Please click an SVG first.", "No selection", wxICON_INFORMATION);
         return;
@@ -80,71 +109,53 @@ void MainFrame::OnChangeSvgColor(wxCommandEvent&)
     if (colorDlg.ShowModal() != wxID_OK) return;
     std::string color = colorDlg.GetValue().ToStdString();
 
-    // Access the lunasvg document
-    auto doc = hit->svg.GetDocument();
-    if (!doc)
+    if (!item->svg.GetDocument())
     {
         wxMessageBox("SVG document not loaded.", "Error", wxICON_ERROR);
         return;
     }
 
-    // Use querySelectorAll to find matching elements
+    // Apply the fill attribute to every element matching the selector. The edit
+    // goes to a private copy if other items share the document, and is recorded
+    // so a saved scene keeps it; the canvas repaints only what it changed.
+    size_t changed = 0;
     try
     {
-        auto elems = doc->querySelectorAll(selector);
-        if (elems.empty())
-        {
-            // No matches — inform user and return
-            wxMessageBox("No elements matched the selector.", "No match", wxICON_INFORMATION);
-            return;
-        }
-
-        // Apply the fill attribute to each element
-        for (auto &el : elems)
-        {
-            el.setAttribute("fill", color);
-        }
+        changed = m_canvas->ApplyEdit(hit, SvgDomEdit{ SvgDomEdit::SetAttribute, selector, 0, "fill", color });
     }
     catch (...)
     {
         // If querySelectorAll throws (very unlikely), fall back to setting document-level property
         // (some builds may differ slightly). Use a safe fallback:
         try {
-            doc->applyStyleSheet("* { fill: " + color + " !important; }");
+            changed = m_canvas->ApplyEdit(hit, SvgDomEdit{ SvgDomEdit::ApplyStyleSheet, std::string(), 0, std::string(),
+                                                            "* { fill: " + color + " !important; }" });
         } catch (...) {
             wxMessageBox("Failed to modify document with DOM API and stylesheet fallback.", "Error", wxICON_ERROR);
             return;
         }
     }
 
-    // Mark dirty and re-render the modified SVG at the current zoom/size so the cache gets updated immediately.
-    hit->svg.MarkDirty();
-
-    // Calculate render size (use the item's baseSize and the canvas zoom)
-    int w = static_cast<int>(std::round(hit->baseSize.GetWidth() * m_canvas->GetZoom()));
-    int h = static_cast<int>(std::round(hit->baseSize.GetHeight() * m_canvas->GetZoom()));
-    if (w <= 0) w = 1;
-    if (h <= 0) h = 1;
-
-    // Re-render (this updates the SvgImageLuna internal cache)
-    wxBitmap newBmp = hit->svg.Render(w, h, m_canvas->GetZoom());
-    (void)newBmp; // we don't need to use it here; it's cached inside SvgImageLuna
-
-    // Refresh canvas to show changes
-    m_canvas->Refresh(false);
+    if (!changed)
+    {
+        // No matches — inform user and return
+        wxMessageBox("No elements matched the selector.", "No match", wxICON_INFORMATION);
+        return;
+    }
 }
 
 void MainFrame::OnChangeSvgText(wxCommandEvent&)
 {
-    auto hit = m_canvas->GetSelectedSvg();
-    if (!hit)
+    SvgItemHandle hit = m_canvas->GetSelectedItem();
+    SvgItem* item = m_canvas->GetItem(hit);
+    if (!item)
     {
         wxMessageBox("Please click an SVG first.");
         return;
     }
 
     // Access the SVG document
-    auto doc = hit->svg.GetDocument();
+    auto doc = item->svg.GetDocument();
     if (!doc)
         return;
 
@@ -196,22 +207,60 @@ void MainFrame::OnChangeSvgText(wxCommandEvent&)
 
     std::string newText = textDlg.GetValue().ToStdString();
 
-    // Update the selected <text> element
-    auto children = elements[selIndex].children();
-    for (auto& child : children)
+    // Update the selected <text> element, in a private copy if other items share
+    // the document; the canvas repaints the old and new extent of the text
+    m_canvas->ApplyEdit(hit, SvgDomEdit{ SvgDomEdit::SetText, "text", static_cast<unsigned>(selIndex), std::string(), newText });
+}
+
+void MainFrame::OnOpenScene(wxCommandEvent&)
+{
+    wxFileDialog dlg(this, "Open Scene", wxEmptyString, wxEmptyString,
+                     "SVG scenes (*.svgscene)|*.svgscene|All files|*", wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+    if (dlg.ShowModal() != wxID_OK)
+        return;
+
+    if (!m_canvas->LoadScene(dlg.GetPath().ToStdString()))
+        wxMessageBox("The file is not a valid scene.", "Open Scene", wxICON_ERROR);
+}
+
+void MainFrame::OnSaveScene(wxCommandEvent&)
+{
+    wxFileDialog dlg(this, "Save Scene", wxEmptyString, "scene.svgscene",
+                     "SVG scenes (*.svgscene)|*.svgscene", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+    if (dlg.ShowModal() != wxID_OK)
+        return;
+
+    if (!m_canvas->SaveScene(dlg.GetPath().ToStdString()))
+        wxMessageBox("The scene could not be saved.", "Save Scene", wxICON_ERROR);
+}
+
+void MainFrame::OnProfilerOverlay(wxCommandEvent& evt)
+{
+    m_canvas->SetProfilerOverlay(evt.IsChecked());
+}
+
+void MainFrame::OnRecordTrace(wxCommandEvent& evt)
+{
+    SvgProfiler& profiler = SvgProfiler::Get();
+    if (evt.IsChecked())
     {
-        if (child.isTextNode())
-        {
-            auto textNode = child.toTextNode();
-            textNode.setData(newText);
-        }
+        profiler.StartTrace();
+        return;
     }
 
-    // Force re-render
-    hit->svg.MarkDirty();
-    m_canvas->Refresh();
-}
+    // Stop recording before asking, so the dialog does not end up in the trace
+    profiler.StopTrace();
+    if (!m_canvas->IsProfilerOverlay())
+        profiler.SetEnabled(false);
+
+    wxFileDialog dlg(this, "Save Trace", wxEmptyString, "svg_canvas_trace.json",
+                     "Chrome traces (*.json)|*.json", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+    if (dlg.ShowModal() != wxID_OK)
+        return;
 
+    if (!profiler.WriteTrace(dlg.GetPath().ToStdString()))
+        wxMessageBox("The trace could not be saved.", "Record Trace", wxICON_ERROR);
+}
 
 // App
 class MyApp : public wxApp
@@ -0,0 +1,355 @@
+#include "svg_bitmap_atlas.h"
+
+#include <wx/rawbmp.h>
+
+#include <algorithm>
+#include <cstring>
+
+// Fully transparent 32-bit page
+static wxBitmap CreatePage(int size);
+
+// Copy a rectangle of pixels, alpha included, between bitmaps of the same format
+static bool CopyPixels(const wxBitmap& src, const wxRect& from, wxBitmap& dst, int x, int y);
+
+SvgBitmapAtlas::SvgBitmapAtlas(int pageSize, size_t maxPages)
+    : m_pageSize(std::max(static_cast<int>(MaxItemSide), pageSize))
+    , m_maxPages(maxPages)
+    , m_frame(0)
+    , m_repacks(0)
+    , m_evictions(0)
+    , m_frees(0)
+{
+}
+
+const SvgBitmapAtlas::Slot* SvgBitmapAtlas::Find(const void* owner, int width, int height, unsigned generation)
+{
+    auto found = m_owners.find(owner);
+    if (found == m_owners.end())
+        return nullptr;
+
+    for (size_t index : found->second)
+    {
+        Slot& slot = m_slots[index];
+        if (slot.generation == generation && slot.width == width && slot.height == height)
+        {
+            slot.lastUse = m_frame;
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+const SvgBitmapAtlas::Slot* SvgBitmapAtlas::Store(const void* owner, const wxBitmap& bitmap, unsigned generation)
+{
+    const int width = bitmap.GetWidth();
+    const int height = bitmap.GetHeight();
+    if (!Accepts(width, height) || !bitmap.HasAlpha())
+        return nullptr;
+
+    // First page with room, else a new page, else room made by repacking one.
+    // The owner's slots stay until this succeeds: a failed store changes nothing.
+    int page = 0;
+    int x = 0;
+    int y = 0;
+    while (page < static_cast<int>(m_pages.size()) && !Allocate(m_pages[page], width, height, x, y))
+        ++page;
+    if (page == static_cast<int>(m_pages.size()) && !(AddPage() && Allocate(m_pages[page], width, height, x, y)))
+    {
+        page = Reclaim(width, height);
+        if (page < 0 || !Allocate(m_pages[page], width, height, x, y))
+            return nullptr;
+    }
+
+    // On failure the allocated space is just dead until the page is repacked
+    if (!CopyPixels(bitmap, wxRect(0, 0, width, height), m_pages[page].bitmap, x, y))
+        return nullptr;
+
+    // Drop what this render supersedes; a size still drawn in this frame belongs
+    // to another item showing the same document
+    auto found = m_owners.find(owner);
+    if (found != m_owners.end())
+    {
+        std::vector<size_t>& indices = found->second;
+        for (size_t i = 0; i < indices.size(); )
+        {
+            const Slot& old = m_slots[indices[i]];
+            const bool sameSize = old.width == width && old.height == height;
+            if (old.generation != generation || sameSize || old.lastUse != m_frame)
+            {
+                ForgetSlot(indices[i]);
+                indices.erase(indices.begin() + i);
+            }
+            else
+                ++i;
+        }
+    }
+
+    size_t index;
+    if (!m_freeSlots.empty())
+    {
+        index = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    }
+    else
+    {
+        index = m_slots.size();
+        m_slots.emplace_back();
+    }
+
+    Slot& slot = m_slots[index];
+    slot.owner = owner;
+    slot.width = width;
+    slot.height = height;
+    slot.generation = generation;
+    slot.page = page;
+    slot.x = x;
+    slot.y = y;
+    slot.lastUse = m_frame;
+
+    m_owners[owner].push_back(index);
+    m_pages[page].usedPixels += static_cast<size_t>(width) * height;
+    return &slot;
+}
+
+void SvgBitmapAtlas::RemoveOwner(const void* owner)
+{
+    auto found = m_owners.find(owner);
+    if (found == m_owners.end())
+        return;
+
+    for (size_t index : found->second)
+        ForgetSlot(index);
+    m_owners.erase(found);
+}
+
+void SvgBitmapAtlas::Clear()
+{
+    ++m_frees;
+    m_pages.clear();
+    m_slots.clear();
+    m_freeSlots.clear();
+    m_owners.clear();
+}
+
+SvgBitmapAtlas::Stats SvgBitmapAtlas::GetStats() const
+{
+    Stats stats;
+    stats.pages = m_pages.size();
+    stats.slots = m_slots.size() - m_freeSlots.size();
+    stats.usedPixels = 0;
+    for (const Page& page : m_pages)
+        stats.usedPixels += page.usedPixels;
+    stats.pagePixels = m_pages.size() * static_cast<size_t>(m_pageSize) * m_pageSize;
+    stats.repacks = m_repacks;
+    stats.evictions = m_evictions;
+    return stats;
+}
+
+bool SvgBitmapAtlas::Allocate(Page& page, int width, int height, int& x, int& y) const
+{
+    // Shelf heights are rounded so renders of nearby sizes share shelves
+    const int shelfHeight = std::min(m_pageSize, (height + 7) & ~7);
+
+    // Lowest shelf it fits on
+    Shelf* best = nullptr;
+    for (Shelf& shelf : page.shelves)
+    {
+        if (shelf.height >= height && shelf.x + width <= m_pageSize && (!best || shelf.height < best->height))
+            best = &shelf;
+    }
+
+    // A much taller shelf wastes most of the slot's column: open a new one while there is room
+    if ((!best || best->height > 2 * shelfHeight) && page.bottom + shelfHeight <= m_pageSize)
+    {
+        page.shelves.push_back(Shelf{ page.bottom, shelfHeight, 0 });
+        page.bottom += shelfHeight;
+        best = &page.shelves.back();
+    }
+    if (!best)
+        return false;
+
+    x = best->x;
+    y = best->y;
+    best->x += width;
+    return true;
+}
+
+bool SvgBitmapAtlas::AddPage()
+{
+    if (m_pages.size() >= m_maxPages)
+        return false;
+
+    Page page;
+    page.bitmap = CreatePage(m_pageSize);
+    if (!page.bitmap.IsOk())
+        return false;
+    page.bottom = 0;
+    page.usedPixels = 0;
+    m_pages.push_back(std::move(page));
+    return true;
+}
+
+int SvgBitmapAtlas::Reclaim(int width, int height)
+{
+    const size_t pageArea = static_cast<size_t>(m_pageSize) * m_pageSize;
+    const size_t needed = static_cast<size_t>(width) * height;
+
+    // The page with the most to give: dead space plus slots not drawn in this frame
+    std::vector<size_t> available(m_pages.size());
+    for (size_t i = 0; i < m_pages.size(); ++i)
+        available[i] = pageArea - m_pages[i].usedPixels;
+    for (const Slot& slot : m_slots)
+    {
+        if (slot.owner && slot.lastUse != m_frame)
+            available[slot.page] += static_cast<size_t>(slot.width) * slot.height;
+    }
+
+    const auto best = std::max_element(available.begin(), available.end());
+    if (best == available.end() || *best < needed)
+        return -1;
+    const int page = static_cast<int>(best - available.begin());
+
+    // Evict least recently drawn first, until half the page is free: shelves waste
+    // some of it, and the next allocations should not have to repack straight away
+    std::vector<size_t> candidates;
+    for (size_t i = 0; i < m_slots.size(); ++i)
+    {
+        if (m_slots[i].owner && m_slots[i].page == page && m_slots[i].lastUse != m_frame)
+            candidates.push_back(i);
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [this](size_t a, size_t b) { return m_slots[a].lastUse < m_slots[b].lastUse; });
+
+    const size_t target = std::max(needed, pageArea / 2);
+    for (size_t index : candidates)
+    {
+        if (pageArea - m_pages[page].usedPixels >= target)
+            break;
+        RemoveSlot(index);
+        ++m_evictions;
+    }
+
+    Repack(page);
+    return page;
+}
+
+void SvgBitmapAtlas::Repack(int page)
+{
+    Page packed;
+    packed.bitmap = CreatePage(m_pageSize);
+    if (!packed.bitmap.IsOk())
+        return;
+    packed.bottom = 0;
+    packed.usedPixels = 0;
+
+    // Tallest first packs shelves tightly
+    std::vector<size_t> live;
+    for (size_t i = 0; i < m_slots.size(); ++i)
+    {
+        if (m_slots[i].owner && m_slots[i].page == page)
+            live.push_back(i);
+    }
+    std::sort(live.begin(), live.end(), [this](size_t a, size_t b)
+    {
+        const Slot& sa = m_slots[a];
+        const Slot& sb = m_slots[b];
+        return sa.height != sb.height ? sa.height > sb.height : sa.width > sb.width;
+    });
+
+    const wxBitmap& old = m_pages[page].bitmap;
+    for (size_t index : live)
+    {
+        Slot& slot = m_slots[index];
+        int x;
+        int y;
+        if (Allocate(packed, slot.width, slot.height, x, y)
+            && CopyPixels(old, wxRect(slot.x, slot.y, slot.width, slot.height), packed.bitmap, x, y))
+        {
+            slot.x = x;
+            slot.y = y;
+            packed.usedPixels += static_cast<size_t>(slot.width) * slot.height;
+        }
+        else
+        {
+            RemoveSlot(index);
+            ++m_evictions;
+        }
+    }
+
+    m_pages[page] = std::move(packed);
+    ++m_repacks;
+}
+
+void SvgBitmapAtlas::RemoveSlot(size_t index)
+{
+    auto found = m_owners.find(m_slots[index].owner);
+    if (found != m_owners.end())
+    {
+        std::vector<size_t>& indices = found->second;
+        indices.erase(std::remove(indices.begin(), indices.end(), index), indices.end());
+        if (indices.empty())
+            m_owners.erase(found);
+    }
+    ForgetSlot(index);
+}
+
+void SvgBitmapAtlas::ForgetSlot(size_t index)
+{
+    Slot& slot = m_slots[index];
+    m_pages[slot.page].usedPixels -= static_cast<size_t>(slot.width) * slot.height;
+    slot.owner = nullptr;
+    slot.page = -1;
+    m_freeSlots.push_back(index);
+    ++m_frees;
+}
+
+static wxBitmap CreatePage(int size)
+{
+    wxBitmap page(size, size, 32);
+    if (!page.IsOk())
+        return wxBitmap();
+    page.UseAlpha();
+
+    wxAlphaPixelData data(page);
+    if (!data)
+        return wxBitmap();
+
+    wxAlphaPixelData::Iterator rowStart(data);
+    for (int row = 0; row < size; ++row)
+    {
+        wxAlphaPixelData::Iterator p = rowStart;
+        for (int col = 0; col < size; ++col, ++p)
+        {
+            p.Red() = 0;
+            p.Green() = 0;
+            p.Blue() = 0;
+            p.Alpha() = 0;
+        }
+        rowStart.OffsetY(data, 1);
+    }
+    return page;
+}
+
+static bool CopyPixels(const wxBitmap& src, const wxRect& from, wxBitmap& dst, int x, int y)
+{
+    // Pixel access needs a non-const bitmap; the copy shares the pixels and is only read
+    wxBitmap source(src);
+    wxAlphaPixelData in(source, from);
+    wxAlphaPixelData out(dst, wxRect(x, y, from.width, from.height));
+    if (!in || !out)
+        return false;
+
+    // Both sides hold the same format (premultiplied or not), so rows copy as they
+    // are. Rows are walked through the iterators: their stride may be negative
+    // (bottom-up DIBs).
+    const size_t rowBytes = static_cast<size_t>(from.width) * (wxAlphaPixelData::PixelFormat::BitsPerPixel / 8);
+    wxAlphaPixelData::Iterator inRow(in);
+    wxAlphaPixelData::Iterator outRow(out);
+    for (int row = 0; row < from.height; ++row)
+    {
+        memcpy(outRow.m_ptr, inRow.m_ptr, rowBytes);
+        inRow.OffsetY(in, 1);
+        outRow.OffsetY(out, 1);
+    }
+    return true;
+}
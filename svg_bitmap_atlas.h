@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+#include <wx/bitmap.h>
+
+// Shared pages for small renders. A whole-image render of at most MaxItemSide
+// pixels a side is copied into a slot of one of a few large 32-bit bitmaps and
+// drawn from there as a sub-rectangle blit, so the number of native bitmaps
+// follows the number of pages, not the number of items.
+//
+// Slots are keyed like SvgBitmapCache entries: owner (document), pixel size and
+// generation. Pages are filled by shelf packing: rows of similar height, each
+// filled left to right. Space freed by a removed slot is reclaimed by repacking
+// its page, one page at a time when an allocation finds every page full: the
+// least recently drawn slots of the page with the most to give are evicted, and
+// the rest are copied into a fresh page packed tallest first.
+//
+// Pages change on Store(): a page must not be selected into a device context
+// then. UI thread only.
+class SvgBitmapAtlas
+{
+public:
+    enum { DefaultPageSize = 1024 };
+    enum { DefaultMaxPages = 16 };  // 64 MB at the default page size
+    enum { MaxItemSide = 64 };      // larger renders keep a bitmap of their own
+
+    struct Slot
+    {
+        const void* owner;          // nullptr while the slot is free
+        int width;
+        int height;
+        unsigned generation;        // owner's document generation when rendered
+        int page;
+        int x;                      // top-left within the page
+        int y;
+        unsigned long long lastUse; // frame in which it was last drawn
+    };
+
+    struct Stats
+    {
+        size_t pages;
+        size_t slots;
+        size_t usedPixels;          // in live slots
+        size_t pagePixels;          // of all pages
+        unsigned long long repacks;
+        unsigned long long evictions;
+    };
+
+    explicit SvgBitmapAtlas(int pageSize = DefaultPageSize, size_t maxPages = DefaultMaxPages);
+
+    SvgBitmapAtlas(const SvgBitmapAtlas&) = delete;
+    SvgBitmapAtlas& operator=(const SvgBitmapAtlas&) = delete;
+
+    static bool Accepts(int width, int height) { return width > 0 && height > 0 && width <= MaxItemSide && height <= MaxItemSide; }
+
+    // Start of a paint: slots found from now on count as drawn in this frame and
+    // are never evicted to make room during it
+    void BeginFrame() { ++m_frame; }
+
+    // Slot holding this exact render, marked as drawn; nullptr if none. Valid
+    // until the next Store() or removal.
+    const Slot* Find(const void* owner, int width, int height, unsigned generation);
+
+    // Copy a render of 'owner' into a slot, replacing its stale slots and those
+    // at other sizes not drawn in this frame (an item re-rendered at a new size).
+    // nullptr if the render is too big, has no alpha, or finds no room even after
+    // repacking; the owner's slots are then left as they were.
+    const Slot* Store(const void* owner, const wxBitmap& bitmap, unsigned generation);
+
+    // Slots freed so far. A Store() that found no room cannot succeed before this
+    // moves on, so callers remember it to skip retrying every frame.
+    unsigned long long GetFreeCount() const { return m_frees; }
+
+    const wxBitmap& GetPage(int page) const { return m_pages[page].bitmap; }
+
+    void RemoveOwner(const void* owner);
+    void Clear();
+
+    Stats GetStats() const;
+
+private:
+    struct Shelf
+    {
+        int y;
+        int height;
+        int x; // next free column
+    };
+
+    struct Page
+    {
+        wxBitmap bitmap;
+        std::vector<Shelf> shelves;
+        int bottom;        // top of the unused strip below the last shelf
+        size_t usedPixels; // in live slots; the rest up to the shelves is dead until repacked
+    };
+
+    bool Allocate(Page& page, int width, int height, int& x, int& y) const;
+    bool AddPage();
+    int Reclaim(int width, int height); // evict and repack one page so a slot this big may fit; its index, or -1
+    void Repack(int page);
+    void RemoveSlot(size_t index);
+    void ForgetSlot(size_t index); // free the slot, leaving the owner's list alone
+
+private:
+    int m_pageSize;
+    size_t m_maxPages;
+    std::vector<Page> m_pages;
+    std::vector<Slot> m_slots;
+    std::vector<size_t> m_freeSlots;                                 // indices into m_slots
+    std::unordered_map<const void*, std::vector<size_t>> m_owners;   // slot indices per owner
+    unsigned long long m_frame;
+    unsigned long long m_repacks;
+    unsigned long long m_evictions;
+    unsigned long long m_frees;
+};
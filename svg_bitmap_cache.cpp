@@ -0,0 +1,365 @@
+#include "svg_bitmap_cache.h"
+
+#include <algorithm>
+#include <utility>
+
+SvgBitmapCache::SvgBitmapCache(size_t budgetBytes)
+    : m_budget(budgetBytes)
+    , m_bytes(0)
+    , m_pinStamp(0)
+    , m_useClock(0)
+    , m_hits(0)
+    , m_misses(0)
+    , m_evictions(0)
+{
+}
+
+const SvgBitmapCache::Entry* SvgBitmapCache::Find(const void* owner, int width, int height, int tile,
+                                                  unsigned generation, bool countStats)
+{
+    EntryList::iterator it;
+    if (!FindEntry(owner, width, height, tile, generation, false, it))
+    {
+        if (countStats) ++m_misses;
+        return nullptr;
+    }
+
+    if (countStats) ++m_hits;
+    Touch(it);
+    return &*it;
+}
+
+const SvgBitmapCache::Entry* SvgBitmapCache::FindNearest(const void* owner, int width, int height,
+                                                         unsigned generation)
+{
+    EntryList::iterator it;
+    if (!FindNearestEntry(owner, width, height, generation, false, it))
+        return nullptr;
+
+    Touch(it);
+    return &*it;
+}
+
+void SvgBitmapCache::GetEntries(const void* owner, unsigned generation, std::vector<Entry*>& out)
+{
+    auto found = m_owners.find(owner);
+    if (found == m_owners.end())
+        return;
+
+    for (auto it : found->second)
+    {
+        if (it->generation == generation)
+            out.push_back(&*it);
+    }
+}
+
+size_t SvgBitmapCache::CopyOwner(const void* from, unsigned generation, const void* to, unsigned toGeneration)
+{
+    auto found = m_owners.find(from);
+    if (found == m_owners.end() || from == to)
+        return 0;
+
+    std::vector<EntryList::iterator>& entries = m_owners[to];
+    size_t copied = 0;
+    for (EntryList::iterator it : found->second)
+    {
+        if (it->generation != generation || IsReleased(*it))
+            continue;
+
+        Entry entry = *it;
+        entry.owner = to;
+        entry.bitmap = it->bitmap.GetSubBitmap(wxRect(0, 0, it->bitmap.GetWidth(), it->bitmap.GetHeight()));
+        if (!entry.bitmap.IsOk())
+            continue;
+        entry.generation = toGeneration;
+        entry.lastUse = ++m_useClock;
+        entry.pinStamp = 0;
+
+        m_lru.push_back(std::move(entry));
+        entries.push_back(std::prev(m_lru.end()));
+        m_bytes += entries.back()->bytes;
+        ++copied;
+    }
+    return copied;
+}
+
+const SvgBitmapCache::Entry* SvgBitmapCache::FindLast(const void* owner) const
+{
+    EntryList::iterator it;
+    return FindLastEntry(owner, false, it) ? &*it : nullptr;
+}
+
+const SvgBitmapCache::Entry* SvgBitmapCache::FindMask(const void* owner, int width, int height, unsigned generation)
+{
+    EntryList::iterator it;
+    if (!FindEntry(owner, width, height, WholeImage, generation, true, it)
+        && !FindNearestEntry(owner, width, height, generation, true, it))
+    {
+        // Stale, but the shape rarely moves much
+        return FindLastEntry(owner, true, it) ? &*it : nullptr;
+    }
+
+    Touch(it);
+    return &*it;
+}
+
+const SvgBitmapCache::Entry* SvgBitmapCache::Store(const void* owner, const wxBitmap& bitmap, SvgHitMask& mask,
+                                                   int width, int height, int tile, unsigned generation, size_t maxLevels)
+{
+    std::vector<EntryList::iterator>& entries = m_owners[owner];
+
+    // Stale entries and an older render of the same size and tile are replaced
+    bool haveLevel = false;
+    for (size_t i = 0; i < entries.size(); )
+    {
+        EntryList::iterator it = entries[i];
+        const bool sameSize = it->width == width && it->height == height;
+        if (it->generation != generation || (sameSize && it->tile == tile))
+        {
+            entries.erase(entries.begin() + i);
+            Erase(it);
+        }
+        else
+        {
+            haveLevel = haveLevel || sameSize;
+            ++i;
+        }
+    }
+
+    // Level limit: drop every entry of the owner's least recently drawn other size
+    if (!haveLevel)
+    {
+        struct Level
+        {
+            int width;
+            int height;
+            unsigned long long lastUse; // most recent use of any of its entries
+        };
+
+        for (;;)
+        {
+            std::vector<Level> levels;
+            for (EntryList::iterator it : entries)
+            {
+                auto level = std::find_if(levels.begin(), levels.end(),
+                    [it](const Level& l) { return l.width == it->width && l.height == it->height; });
+                if (level == levels.end())
+                    levels.push_back(Level{ it->width, it->height, it->lastUse });
+                else
+                    level->lastUse = std::max(level->lastUse, it->lastUse);
+            }
+            if (levels.size() < maxLevels)
+                break;
+
+            auto oldest = std::min_element(levels.begin(), levels.end(),
+                [](const Level& a, const Level& b) { return a.lastUse < b.lastUse; });
+            EraseLevel(entries, oldest->width, oldest->height);
+        }
+    }
+
+    Entry entry;
+    entry.owner = owner;
+    entry.bitmap = bitmap;
+    std::swap(entry.mask, mask);
+    entry.width = width;
+    entry.height = height;
+    entry.tile = tile;
+    entry.generation = generation;
+    entry.bytes = static_cast<size_t>(bitmap.GetWidth()) * bitmap.GetHeight() * 4 + GetMaskBytes(entry.mask);
+    entry.lastUse = ++m_useClock;
+    entry.pinStamp = 0;
+
+    m_lru.push_back(std::move(entry));
+    EntryList::iterator it = std::prev(m_lru.end());
+    entries.push_back(it);
+    m_bytes += it->bytes;
+    return &*it;
+}
+
+void SvgBitmapCache::ReleaseBitmap(const void* owner, int width, int height, int tile, unsigned generation)
+{
+    auto found = m_owners.find(owner);
+    if (found == m_owners.end())
+        return;
+
+    for (EntryList::iterator it : found->second)
+    {
+        if (it->generation == generation && it->width == width && it->height == height && it->tile == tile)
+        {
+            it->bitmap = wxNullBitmap;
+            m_bytes -= it->bytes;
+            it->bytes = GetMaskBytes(it->mask);
+            m_bytes += it->bytes;
+            return;
+        }
+    }
+}
+
+void SvgBitmapCache::RemoveOwner(const void* owner)
+{
+    auto found = m_owners.find(owner);
+    if (found == m_owners.end())
+        return;
+
+    for (EntryList::iterator it : found->second)
+        Erase(it);
+    m_owners.erase(found);
+}
+
+void SvgBitmapCache::Clear()
+{
+    m_lru.clear();
+    m_owners.clear();
+    m_bytes = 0;
+}
+
+void SvgBitmapCache::Pin(const void* owner, int width, int height)
+{
+    auto found = m_owners.find(owner);
+    if (found == m_owners.end())
+        return;
+
+    bool pinned = false;
+    for (EntryList::iterator it : found->second)
+    {
+        if (it->width == width && it->height == height)
+        {
+            it->pinStamp = m_pinStamp;
+            pinned = true;
+        }
+    }
+    if (pinned)
+        return;
+
+    // Not rendered at this size yet: whatever stand-in is drawn must survive too
+    for (EntryList::iterator it : found->second)
+        it->pinStamp = m_pinStamp;
+}
+
+void SvgBitmapCache::Trim()
+{
+    EntryList::iterator it = m_lru.begin();
+    while (IsOverBudget() && it != m_lru.end())
+    {
+        if (it->pinStamp == m_pinStamp)
+        {
+            ++it;
+            continue;
+        }
+
+        EntryList::iterator victim = it++;
+        std::vector<EntryList::iterator>& entries = m_owners[victim->owner];
+        entries.erase(std::find(entries.begin(), entries.end(), victim));
+        if (entries.empty())
+            m_owners.erase(victim->owner);
+        Erase(victim);
+        ++m_evictions;
+    }
+}
+
+SvgBitmapCache::Stats SvgBitmapCache::GetStats() const
+{
+    Stats stats;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.evictions = m_evictions;
+    stats.bytes = m_bytes;
+    stats.budget = m_budget;
+    stats.entries = m_lru.size();
+    return stats;
+}
+
+bool SvgBitmapCache::FindEntry(const void* owner, int width, int height, int tile, unsigned generation,
+                               bool released, EntryList::iterator& out) const
+{
+    auto found = m_owners.find(owner);
+    if (found == m_owners.end())
+        return false;
+
+    for (EntryList::iterator it : found->second)
+    {
+        if (it->generation == generation && it->width == width && it->height == height && it->tile == tile
+            && (released || !IsReleased(*it)))
+        {
+            out = it;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SvgBitmapCache::FindNearestEntry(const void* owner, int width, int height, unsigned generation,
+                                      bool released, EntryList::iterator& out) const
+{
+    auto found = m_owners.find(owner);
+    if (found == m_owners.end())
+        return false;
+
+    // Smallest entry that covers the target (downscaling looks fine), else the largest one
+    bool above = false;
+    bool below = false;
+    EntryList::iterator bestAbove;
+    EntryList::iterator bestBelow;
+    for (EntryList::iterator it : found->second)
+    {
+        if (it->generation != generation || it->tile != WholeImage || (!released && IsReleased(*it)))
+            continue;
+
+        if (it->width >= width && it->height >= height)
+        {
+            if (!above || it->width < bestAbove->width)
+                bestAbove = it;
+            above = true;
+        }
+        else if (!below || it->width > bestBelow->width)
+        {
+            bestBelow = it;
+            below = true;
+        }
+    }
+
+    if (!above && !below)
+        return false;
+    out = above ? bestAbove : bestBelow;
+    return true;
+}
+
+bool SvgBitmapCache::FindLastEntry(const void* owner, bool released, EntryList::iterator& out) const
+{
+    auto found = m_owners.find(owner);
+    if (found == m_owners.end())
+        return false;
+
+    const auto& entries = found->second;
+    for (auto it = entries.rbegin(); it != entries.rend(); ++it)
+    {
+        if ((*it)->tile == WholeImage && (released || !IsReleased(**it)))
+        {
+            out = *it;
+            return true;
+        }
+    }
+    return false;
+}
+
+void SvgBitmapCache::EraseLevel(std::vector<EntryList::iterator>& entries, int width, int height)
+{
+    for (size_t i = 0; i < entries.size(); )
+    {
+        EntryList::iterator it = entries[i];
+        if (it->width == width && it->height == height)
+        {
+            entries.erase(entries.begin() + i);
+            Erase(it);
+            ++m_evictions;
+        }
+        else
+            ++i;
+    }
+}
+
+void SvgBitmapCache::Erase(EntryList::iterator it)
+{
+    m_bytes -= it->bytes;
+    m_lru.erase(it);
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include <wx/bitmap.h>
+#include "svg_hit_mask.h"
+
+// Canvas-wide owner of rendered bitmaps. Entries are keyed by an owner (the
+// document they were rendered from), the pixel size of the whole image and,
+// for tiled renders, a tile index; they are accounted in bytes.
+// When the byte budget is exceeded, Trim() evicts the least recently drawn
+// entries, skipping those pinned as currently visible.
+// UI thread only.
+class SvgBitmapCache
+{
+public:
+    enum { DefaultBudgetMB = 256 };
+    enum { WholeImage = -1 }; // tile index of an untiled render
+
+    struct Entry
+    {
+        const void* owner;
+        wxBitmap bitmap;
+        SvgHitMask mask;          // alpha mask of bitmap
+        int width;                // size of the whole image
+        int height;
+        int tile;                 // WholeImage, or row-major tile index
+        unsigned generation;      // owner's document generation when rendered
+        size_t bytes;
+        unsigned long long lastUse;
+        unsigned pinStamp;
+    };
+
+    struct Stats
+    {
+        unsigned long long hits;
+        unsigned long long misses;
+        unsigned long long evictions;
+        size_t bytes;
+        size_t budget;
+        size_t entries;
+    };
+
+    // budgetBytes == 0 means unlimited
+    explicit SvgBitmapCache(size_t budgetBytes = size_t(DefaultBudgetMB) << 20);
+
+    SvgBitmapCache(const SvgBitmapCache&) = delete;
+    SvgBitmapCache& operator=(const SvgBitmapCache&) = delete;
+
+    void SetBudget(size_t budgetBytes) { m_budget = budgetBytes; }
+    size_t GetBudget() const { return m_budget; }
+    bool IsOverBudget() const { return m_budget != 0 && m_bytes > m_budget; }
+
+    // Lookups for drawing skip entries whose bitmap was released (ReleaseBitmap()):
+    // such a render is drawn from elsewhere until that copy goes, then rendered again.
+
+    // Exact size, tile and generation. Counts a hit or miss when countStats is set
+    // and marks the entry as just drawn.
+    const Entry* Find(const void* owner, int width, int height, int tile, unsigned generation,
+                      bool countStats = false);
+
+    // Current-generation whole image closest to (width, height), preferring one at
+    // least that big. Marks it as just drawn.
+    const Entry* FindNearest(const void* owner, int width, int height, unsigned generation);
+
+    // Most recently stored whole image of the owner, any size or generation.
+    const Entry* FindLast(const void* owner) const;
+
+    // Whole image whose hit mask best matches (width, height), released or not:
+    // exact, else nearest current, else the last one stored. Marks it as just drawn.
+    const Entry* FindMask(const void* owner, int width, int height, unsigned generation);
+
+    // Every entry of the owner rendered at 'generation', to be patched in place
+    // (bitmap pixels, mask bits, generation; never size or tile)
+    void GetEntries(const void* owner, unsigned generation, std::vector<Entry*>& out);
+
+    // Give 'to' its own copy (pixels duplicated, not shared) of every entry 'from'
+    // has at 'generation', stored at 'toGeneration'; entries whose bitmap was
+    // released are skipped. For a document detached by copy-on-write, so it starts
+    // with the renders it was copied from. Returns the number of entries copied.
+    size_t CopyOwner(const void* from, unsigned generation, const void* to, unsigned toGeneration);
+
+    // Add a render. Replaces the owner's stale entries and any entry with the same
+    // size and tile. An owner keeps at most maxLevels distinct sizes (all tiles of
+    // one size count as one level); the least recently drawn level goes first.
+    // The mask is moved in.
+    const Entry* Store(const void* owner, const wxBitmap& bitmap, SvgHitMask& mask,
+                       int width, int height, int tile, unsigned generation, size_t maxLevels);
+
+    // Keep only the hit mask of this entry, its pixels now being held elsewhere
+    // (SvgBitmapAtlas). Only FindMask() still returns it; storing a new render of
+    // the same size and tile replaces it.
+    void ReleaseBitmap(const void* owner, int width, int height, int tile, unsigned generation);
+
+    void RemoveOwner(const void* owner);
+    void Clear();
+
+    // Budget enforcement: BeginPin(), Pin() every visible entry, then Trim().
+    void BeginPin() { ++m_pinStamp; }
+    void Pin(const void* owner, int width, int height); // that size (all its tiles), else all of the owner's
+    void Trim();
+
+    Stats GetStats() const;
+    void ResetStats() { m_hits = m_misses = m_evictions = 0; }
+
+private:
+    typedef std::list<Entry> EntryList; // LRU order: front is least recently drawn
+
+    static size_t GetMaskBytes(const SvgHitMask& mask)
+    {
+        return static_cast<size_t>((mask.GetWidth() + 31) / 32) * mask.GetHeight() * 4;
+    }
+
+    static bool IsReleased(const Entry& entry) { return !entry.bitmap.IsOk(); }
+
+    // Lookups behind the public ones; 'released' also accepts entries without a bitmap
+    bool FindEntry(const void* owner, int width, int height, int tile, unsigned generation, bool released,
+                   EntryList::iterator& out) const;
+    bool FindNearestEntry(const void* owner, int width, int height, unsigned generation, bool released,
+                          EntryList::iterator& out) const;
+    bool FindLastEntry(const void* owner, bool released, EntryList::iterator& out) const;
+
+    void Touch(EntryList::iterator it) { it->lastUse = ++m_useClock; m_lru.splice(m_lru.end(), m_lru, it); }
+    void EraseLevel(std::vector<EntryList::iterator>& entries, int width, int height);
+    void Erase(EntryList::iterator it);
+
+private:
+    EntryList m_lru;
+    std::unordered_map<const void*, std::vector<EntryList::iterator>> m_owners; // back = newest
+    size_t m_budget;
+    size_t m_bytes;
+    unsigned m_pinStamp;
+    unsigned long long m_useClock;
+    unsigned long long m_hits;
+    unsigned long long m_misses;
+    unsigned long long m_evictions;
+};
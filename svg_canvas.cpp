@@ -1,14 +1,38 @@
 #include "svg_canvas.h"
+#include "svg_mapped_file.h"
+#include "svg_scene_snapshot.h"
 #include <wx/dcbuffer.h>
+#include <wx/dcclient.h>
 #include <wx/dcmirror.h>
+#include <wx/dcmemory.h>
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <map>
+#include <thread>
+#include <unordered_map>
 
 SvgCanvas::SvgCanvas(wxWindow* parent)
     : wxScrolledWindow(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxHSCROLL | wxVSCROLL | wxBORDER_SIMPLE)
-    , m_dragItem(nullptr)
+    , m_virtualSize(wxDefaultSize)
+    , m_bitmapCache(std::make_shared<SvgBitmapCache>())
+    , m_atlasDCPage(-1)
+    , m_lastBuffers(SvgRenderBufferPool::Get().GetStats())
+    , m_frameBuffers()
     , m_panning(false)
+    , m_panTimer(this)
     , m_zoom(1.0)
-    , m_labelHeight(18)
+    , m_zoomSettling(false)
+    , m_zoomSettleTimer(this)
+    , m_indexZoom(1.0)
+    , m_lod(LodPolicy{ DefaultLodThumbnailSide, DefaultLodProxySide, DefaultLodLabelSide })
+    , m_paintRenders(0)
+    , m_profilerOverlay(false)
+    , m_overlayFrame()
+    , m_asyncRender(false)
+    , m_drainQueued(false)
+    , m_editDepth(0)
 {
     SetBackgroundStyle(wxBG_STYLE_PAINT);
     SetScrollRate(10, 10);
@@ -21,25 +45,234 @@ SvgCanvas::SvgCanvas(wxWindow* parent)
     Bind(wxEVT_RIGHT_DOWN, &SvgCanvas::OnRightDown, this);
     Bind(wxEVT_RIGHT_UP, &SvgCanvas::OnRightUp, this);
     Bind(wxEVT_MOUSEWHEEL, &SvgCanvas::OnMouseWheel, this);
+    Bind(wxEVT_TIMER, &SvgCanvas::OnZoomSettled, this, m_zoomSettleTimer.GetId());
+    Bind(wxEVT_TIMER, &SvgCanvas::OnPanFrame, this, m_panTimer.GetId());
 }
 
-bool SvgCanvas::AddSvgFile(const std::string& filePath, const wxPoint& pos, const wxSize& baseSize, const wxString& label)
+SvgCanvas::~SvgCanvas()
 {
-    auto item = std::make_shared<SvgItem>();
-    if (!item) return false;
+    // Join the workers before any member they write to goes away
+    if (m_renderPool)
+        m_renderPool->Shutdown();
+}
 
+bool SvgCanvas::AddSvgFile(const std::string& filePath, const wxPoint& pos, const wxSize& baseSize, const wxString& label)
+{
+    std::unique_ptr<SvgItem> item(new SvgItem);
     if (!item->svg.LoadFromFile(filePath))
         return false;
 
-    item->pos = pos;
-    item->baseSize = baseSize;
+    InsertItem(std::move(item), pos, baseSize, label);
+    UpdateVirtualSize();
+    Refresh();
+    return true;
+}
+
+size_t SvgCanvas::AddSvgFiles(const std::vector<FileEntry>& entries, std::vector<size_t>* failed)
+{
+    if (entries.empty())
+        return 0;
+
+    std::vector<std::unique_ptr<SvgItem>> items(entries.size());
+    for (auto& item : items)
+        item.reset(new SvgItem);
+    std::unique_ptr<bool[]> loaded(new bool[entries.size()]());
+
+    // Every core reads and parses (the UI thread just waits); workers claim
+    // entries one at a time so a few slow files do not stall a whole chunk.
+    // Only the item's own SvgImageLuna and the thread-safe document store are touched.
+    {
+        std::atomic<size_t> next(0);
+        std::mutex doneMutex;
+        std::condition_variable doneCond;
+        unsigned running;
+
+        SvgWorkerPool pool(std::max(1u, std::thread::hardware_concurrency())); // joined before the above go away
+        const unsigned taskCount = pool.GetThreadCount();
+        running = taskCount;
+
+        for (unsigned t = 0; t < taskCount; ++t)
+        {
+            pool.Submit([&]()
+            {
+                for (size_t i = next++; i < entries.size(); i = next++)
+                    loaded[i] = items[i]->svg.LoadFromFile(entries[i].path);
+
+                std::lock_guard<std::mutex> lock(doneMutex);
+                if (--running == 0)
+                    doneCond.notify_one();
+            });
+        }
+
+        std::unique_lock<std::mutex> lock(doneMutex);
+        doneCond.wait(lock, [&running] { return running == 0; });
+    }
+
+    size_t added = 0;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        if (!loaded[i])
+        {
+            if (failed)
+                failed->push_back(i);
+            continue;
+        }
+
+        InsertItem(std::move(items[i]), entries[i].pos, entries[i].baseSize, entries[i].label);
+        ++added;
+    }
+
+    if (added)
+    {
+        UpdateVirtualSize();
+        Refresh();
+    }
+    return added;
+}
+
+uint32_t SvgCanvas::InsertItem(std::unique_ptr<SvgItem> item, const wxPoint& pos, const wxSize& baseSize, const wxString& label)
+{
     item->label = label;
-    item->visible = true;
+    item->svg.SetBitmapCache(m_bitmapCache);
+    item->svg.SetDiskCache(m_diskCache);
+
+    // Nothing to mark dirty: a freshly loaded image renders on first paint, and
+    // marking would invalidate the renders other items sharing its document hold.
+
+    const uint32_t slot = m_items.Add(std::move(item), pos, baseSize).slot;
+    m_items.SetLabelSize(slot, label.IsEmpty() ? wxSize() : GetTextExtent(label));
+    m_maxBaseSize.IncTo(baseSize);
+
+    m_items.UpdateBounds(slot, m_indexZoom);
+    m_index.Update(slot, m_items.GetBounds(slot));
+    TrackItemBounds(slot);
+    return slot;
+}
+
+bool SvgCanvas::SaveScene(const std::string& filePath) const
+{
+    SvgSceneSnapshot snapshot;
+    snapshot.items.reserve(m_items.GetCount());
+
+    // Sources deduplicated by content, documents by identity: items sharing a
+    // parsed (or not yet parsed) document share its entry
+    std::map<std::pair<unsigned long long, unsigned long long>, unsigned> sourceIndex;
+    std::unordered_map<const void*, unsigned> documentIndex;
+
+    auto addSource = [&](const std::shared_ptr<const std::string>& text, const std::string& path,
+                         unsigned long long hash, unsigned long long checkHash)
+    {
+        auto inserted = sourceIndex.insert(std::make_pair(std::make_pair(hash, checkHash), 0u));
+        if (inserted.second)
+        {
+            inserted.first->second = static_cast<unsigned>(snapshot.sources.size());
+            snapshot.sources.push_back(SvgSceneSnapshot::Source{ text, path });
+        }
+        return inserted.first->second;
+    };
+
+    // Saved in paint order, which loading restores
+    std::vector<uint32_t> order;
+    order.reserve(m_items.GetCount());
+    for (uint32_t slot = 0; slot < m_items.GetSlotCount(); ++slot)
+    {
+        if (m_items.IsLive(slot))
+            order.push_back(slot);
+    }
+    std::sort(order.begin(), order.end(),
+              [this](uint32_t a, uint32_t b) { return m_items.GetZOrder(a) < m_items.GetZOrder(b); });
+
+    for (uint32_t slot : order)
+    {
+        const SvgItem& item = m_items.GetItem(slot);
+        const auto& shared = item.svg.GetSharedDocument();
+        const auto& deferred = item.svg.GetDeferredSource();
+        const void* key = shared ? static_cast<const void*>(shared.get()) : deferred.get();
+        if (!key)
+            continue; // never loaded
+
+        auto found = documentIndex.find(key);
+        if (found == documentIndex.end())
+        {
+            SvgSceneSnapshot::Document doc;
+            if (shared)
+            {
+                auto text = std::make_shared<std::string>();
+                if (!SvgDocumentStore::ReadSource(*shared, *text))
+                    return false;
+                doc.source = addSource(text, shared->path, shared->hash, shared->checkHash);
+                doc.edits = shared->edits;
+            }
+            else
+            {
+                // A source whose text was released is read back from its file
+                std::shared_ptr<const std::string> source = deferred->text;
+                if (!source)
+                {
+                    SvgMappedFile file;
+                    if (deferred->path.empty() || !file.Open(deferred->path))
+                        return false;
+                    source = std::make_shared<std::string>(file.GetData(), file.GetSize());
+                }
+                const std::string& text = *source;
+                doc.source = addSource(source, deferred->path,
+                                       SvgDocumentStore::Hash(text.data(), text.size()),
+                                       SvgDocumentStore::CheckHash(text.data(), text.size()));
+                doc.edits = deferred->edits;
+            }
+            found = documentIndex.insert(std::make_pair(key, static_cast<unsigned>(snapshot.documents.size()))).first;
+            snapshot.documents.push_back(doc);
+        }
+
+        const wxPoint pos = m_items.GetPos(slot);
+        const wxSize baseSize = m_items.GetBaseSize(slot);
+        SvgSceneSnapshot::Item saved;
+        saved.x = pos.x;
+        saved.y = pos.y;
+        saved.width = baseSize.x;
+        saved.height = baseSize.y;
+        saved.visible = m_items.IsVisible(slot);
+        saved.label = item.label.utf8_string();
+        saved.document = found->second;
+        snapshot.items.push_back(saved);
+    }
+    return snapshot.Save(filePath);
+}
 
-    // initial render at current zoom (we leave it dirty so it will render on paint)
-    item->svg.MarkDirty();
+bool SvgCanvas::LoadScene(const std::string& filePath)
+{
+    SvgSceneSnapshot snapshot;
+    if (!snapshot.Load(filePath))
+        return false;
+
+    Clear();
+
+    // One deferred source per document, shared by its items
+    std::vector<std::shared_ptr<const SvgDeferredSource>> deferred;
+    deferred.reserve(snapshot.documents.size());
+    for (const auto& doc : snapshot.documents)
+    {
+        auto source = std::make_shared<SvgDeferredSource>();
+        source->text = snapshot.sources[doc.source].text;
+        source->path = snapshot.sources[doc.source].path;
+        source->edits = doc.edits;
+        deferred.push_back(source);
+    }
+
+    m_items.Reserve(snapshot.items.size());
+    for (const auto& saved : snapshot.items)
+    {
+        std::unique_ptr<SvgItem> item(new SvgItem);
+        item->svg.SetDeferredSource(deferred[saved.document]);
+        const uint32_t slot = InsertItem(std::move(item), wxPoint(saved.x, saved.y), wxSize(saved.width, saved.height),
+                                         wxString::FromUTF8(saved.label.data(), saved.label.size()));
+        if (!saved.visible)
+        {
+            UntrackItemBounds(slot);
+            m_items.SetVisible(slot, false);
+        }
+    }
 
-    m_items.push_back(item);
     UpdateVirtualSize();
     Refresh();
     return true;
@@ -47,23 +280,289 @@ bool SvgCanvas::AddSvgFile(const std::string& filePath, const wxPoint& pos, cons
 
 void SvgCanvas::Clear()
 {
-    m_items.clear();
+    CancelPendingRenders();
+    m_pendingEdits.clear();
+    if (m_atlas)
+    {
+        ReleaseAtlasPage();
+        m_atlas->Clear();
+    }
+    m_items.Clear();
+    m_index.Clear();
+    m_sceneRights.clear();
+    m_sceneBottoms.clear();
+    m_maxBaseSize = wxSize();
+    m_selectedItem = SvgItemHandle();
+    m_dragItem = SvgItemHandle();
     UpdateVirtualSize();
     Refresh();
 }
 
+void SvgCanvas::BeginEdit()
+{
+    ++m_editDepth;
+}
+
+size_t SvgCanvas::ApplyEdit(SvgItemHandle handle, const SvgDomEdit& edit)
+{
+    SvgItem* item = m_items.Get(handle);
+    if (!item)
+        return 0;
+
+    BeginEdit();
+    PendingEdit& pending = m_pendingEdits[handle.slot];
+    pending.item = handle;
+    const size_t changed = item->svg.ApplyEdit(edit, &pending.area);
+    CommitEdit();
+    return changed;
+}
+
+void SvgCanvas::CommitEdit()
+{
+    if (m_editDepth == 0 || --m_editDepth > 0)
+        return;
+
+    std::unordered_map<uint32_t, PendingEdit> pending;
+    pending.swap(m_pendingEdits);
+    for (auto& it : pending)
+    {
+        if (m_items.IsValid(it.second.item))
+            RepaintItemArea(it.second.item.slot, it.second.area);
+    }
+}
+
+void SvgCanvas::RepaintItemArea(uint32_t slot, const SvgDirtyArea& area)
+{
+    if (area.empty)
+        return;
+
+    SvgItem& item = m_items.GetItem(slot);
+    const bool patched = item.svg.RepaintArea(area);
+    if (!m_items.IsVisible(slot))
+        return;
+
+    // Renders not patched went stale and are redrawn whole, which async mode
+    // shows as a placeholder until they arrive: the whole item is invalidated
+    auto document = item.svg.GetDocument();
+    if (!patched || area.whole || !document || document->width() <= 0 || document->height() <= 0)
+    {
+        RefreshItem(slot);
+        return;
+    }
+
+    // Only pixels inside the area differ, so invalidating just that part is enough
+    const wxSize size = GetItemSize(slot);
+    const double sx = size.x / document->width();
+    const double sy = size.y / document->height();
+    const int left = static_cast<int>(std::floor(area.left * sx)) - 2;
+    const int top = static_cast<int>(std::floor(area.top * sy)) - 2;
+    const int right = static_cast<int>(std::ceil(area.right * sx)) + 2;
+    const int bottom = static_cast<int>(std::ceil(area.bottom * sy)) + 2;
+    const wxRect rect = wxRect(left, top, right - left, bottom - top).Intersect(wxRect(wxPoint(0, 0), size));
+    if (!rect.IsEmpty())
+    {
+        const wxPoint pos = m_items.GetPos(slot);
+        RefreshLogicalRect(wxRect(pos.x + rect.x, pos.y + rect.y, rect.width, rect.height));
+    }
+}
+
 void SvgCanvas::SetZoom(double zoom)
 {
     if (zoom <= 0.05) zoom = 0.05;
     if (zoom > 10.0) zoom = 10.0;
+    if (zoom == m_zoom)
+        return;
     m_zoom = zoom;
 
-    // Mark all items dirty so they will be re-rendered at new size on next paint
-    for (auto& it : m_items)
-        it->svg.MarkDirty();
+    // Queued renders are for a size that is already superseded: drop them before
+    // they waste a worker
+    CancelPendingRenders();
 
-    UpdateVirtualSize();
-    Refresh();
+    // Content is unchanged, so cached levels stay valid (the cache is keyed by size).
+    // Until the zoom settles, paint stretches the nearest cached level to fit; the
+    // exact size is rendered once the timer fires. The index and scene extent,
+    // O(items) to rebuild, wait for it too.
+    m_zoomSettling = true;
+    m_zoomSettleTimer.StartOnce(ZoomSettleDelayMs);
+    Refresh(false);
+}
+
+void SvgCanvas::OnZoomSettled(wxTimerEvent& WXUNUSED(evt))
+{
+    SettleZoom();
+}
+
+void SvgCanvas::SettleZoom()
+{
+    m_zoomSettleTimer.Stop();
+    m_zoomSettling = false;
+    if (m_indexZoom != m_zoom)
+    {
+        RebuildIndex();
+        UpdateVirtualSize();
+    }
+    Refresh(false); // now render everything visible at its exact size
+}
+
+wxRect SvgCanvas::GetIndexQueryArea(const wxRect& area) const
+{
+    if (m_zoom <= m_indexZoom)
+        return area; // items only shrank: their indexed bounds still cover them
+
+    // Items grow right and down from their top-left, labels move down with them
+    const int growX = static_cast<int>(std::ceil(m_maxBaseSize.x * (m_zoom - m_indexZoom)));
+    const int growY = static_cast<int>(std::ceil(m_maxBaseSize.y * (m_zoom - m_indexZoom)));
+    return wxRect(area.x - growX, area.y - growY, area.width + growX, area.height + growY);
+}
+
+void SvgCanvas::SetAsyncRender(bool async)
+{
+    if (async == m_asyncRender)
+        return;
+
+    m_asyncRender = async;
+    if (async)
+    {
+        if (!m_renderPool)
+            m_renderPool.reset(new SvgWorkerPool());
+    }
+    else
+        CancelPendingRenders();
+    Refresh(false);
+}
+
+void SvgCanvas::SetCacheBudget(size_t bytes)
+{
+    m_bitmapCache->SetBudget(bytes);
+    ReleaseAtlasPage();
+
+    if (m_bitmapCache->IsOverBudget())
+        TrimBitmapCache();
+}
+
+bool SvgCanvas::DrawFromAtlas(wxDC& dc, SvgItem& item, const wxPoint& pos, const wxSize& size)
+{
+    const SvgBitmapAtlas::Slot* slot = m_atlas->Find(item.svg.GetCacheKey(), size.x, size.y, item.svg.GetGeneration());
+    if (!slot)
+        return false;
+
+    // Items drawn in a row mostly share a page, so the selection rarely changes
+    if (slot->page != m_atlasDCPage)
+    {
+        m_atlasDC.SelectObjectAsSource(m_atlas->GetPage(slot->page));
+        m_atlasDCPage = slot->page;
+    }
+    dc.Blit(pos.x, pos.y, size.x, size.y, &m_atlasDC, slot->x, slot->y, wxCOPY, true);
+    return true;
+}
+
+void SvgCanvas::MoveToAtlas(SvgItem& item, const wxBitmap& bmp)
+{
+    // A full atlas refuses the same render until some slot is freed: keep
+    // drawing the item's own bitmap rather than reclaiming on every paint
+    const unsigned generation = item.svg.GetGeneration();
+    if (item.atlasRefusedGeneration == generation && item.atlasRefusedFrees == m_atlas->GetFreeCount())
+        return;
+
+    // Storing may write to any page, or repack one
+    ReleaseAtlasPage();
+
+    // The cache keeps the hit mask; the atlas now has the only copy of the pixels
+    if (m_atlas->Store(item.svg.GetCacheKey(), bmp, generation))
+    {
+        item.svg.ReleaseCachedBitmap(bmp.GetWidth(), bmp.GetHeight());
+        item.atlasRefusedGeneration = 0;
+    }
+    else
+    {
+        item.atlasRefusedGeneration = generation;
+        item.atlasRefusedFrees = m_atlas->GetFreeCount();
+    }
+}
+
+void SvgCanvas::ReleaseAtlasPage()
+{
+    if (m_atlasDCPage < 0)
+        return;
+
+    m_atlasDC.SelectObjectAsSource(wxNullBitmap);
+    m_atlasDCPage = -1;
+}
+
+void SvgCanvas::SetAtlasMode(bool atlas)
+{
+    if (atlas == IsAtlasMode())
+        return;
+
+    // Renders already moved into the atlas are rendered again when it goes
+    ReleaseAtlasPage();
+    if (atlas)
+        m_atlas.reset(new SvgBitmapAtlas());
+    else
+        m_atlas.reset();
+    Refresh(false);
+}
+
+void SvgCanvas::SetDiskCache(const std::shared_ptr<SvgDiskCache>& cache)
+{
+    m_diskCache = cache;
+    for (uint32_t slot = 0; slot < m_items.GetSlotCount(); ++slot)
+    {
+        if (m_items.IsLive(slot))
+            m_items.GetItem(slot).svg.SetDiskCache(cache);
+    }
+}
+
+void SvgCanvas::SetProfilerOverlay(bool show)
+{
+    if (show == m_profilerOverlay)
+        return;
+
+    m_profilerOverlay = show;
+    if (show)
+        SvgProfiler::Get().SetEnabled(true);
+    else if (!SvgProfiler::Get().IsTracing())
+        SvgProfiler::Get().SetEnabled(false);
+    Refresh(false);
+}
+
+wxRect SvgCanvas::GetProfilerOverlayRect() const
+{
+    // Four lines of text with a small margin
+    return wxRect(8, 8, 44 * GetCharWidth() + 12, 4 * GetCharHeight() + 12);
+}
+
+void SvgCanvas::DrawProfilerOverlay(wxDC& dc, const wxPoint& pos)
+{
+    const SvgProfiler::FrameStats& frame = m_overlayFrame;
+    const unsigned hits = frame.counts[SvgProfiler::CacheHits];
+    const unsigned lookups = hits + frame.counts[SvgProfiler::CacheMisses];
+    const wxString lines[] =
+    {
+        wxString::Format("frame %llu: paint %.2f ms", frame.frame, frame.paintMs),
+        wxString::Format("items: %u rendered, %u blitted, %u culled",
+                         frame.counts[SvgProfiler::Rendered], frame.counts[SvgProfiler::Blitted],
+                         frame.counts[SvgProfiler::Culled]),
+        wxString::Format("cache: %u of %u hit (%.0f%%)", hits, lookups, lookups ? 100.0 * hits / lookups : 100.0),
+        wxString::Format("rasterize %u: %.2f ms, convert %u: %.2f ms",
+                         frame.timed[SvgProfiler::Rasterize], frame.timedMs[SvgProfiler::Rasterize],
+                         frame.timed[SvgProfiler::Convert], frame.timedMs[SvgProfiler::Convert])
+    };
+
+    const wxRect rect(pos, GetProfilerOverlayRect().GetSize());
+    dc.SetPen(*wxTRANSPARENT_PEN);
+    dc.SetBrush(wxBrush(wxColour(32, 32, 32)));
+    dc.DrawRectangle(rect);
+
+    const wxColour text = dc.GetTextForeground();
+    dc.SetTextForeground(*wxWHITE);
+    int y = rect.y + 6;
+    for (const wxString& line : lines)
+    {
+        dc.DrawText(line, rect.x + 6, y);
+        y += GetCharHeight();
+    }
+    dc.SetTextForeground(text);
 }
 
 void SvgCanvas::OnSize(wxSizeEvent& evt)
@@ -74,62 +573,382 @@ void SvgCanvas::OnSize(wxSizeEvent& evt)
 
 void SvgCanvas::OnPaint(wxPaintEvent& WXUNUSED(evt))
 {
-    wxAutoBufferedPaintDC dc(this);
-    PrepareDC(dc);
+    const wxRegion& region = GetUpdateRegion();
+    const wxRect updated = region.GetBox();
+    const wxRect overlay = GetProfilerOverlayRect();
+    {
+        wxAutoBufferedPaintDC dc(this);
+        PrepareDC(dc);
 
-    dc.SetBackground(*wxWHITE_BRUSH);
-    dc.Clear();
+        // Only the update region is repainted, rectangle by rectangle: after a
+        // diagonal scroll it is two strips along adjacent edges, whose bounding box
+        // is the whole window
+        m_paintRects.clear();
+        for (wxRegionIterator it(region); it; ++it)
+        {
+            wxRect rect = it.GetRect();
+            rect.SetPosition(CalcUnscrolledPosition(rect.GetPosition()));
+            m_paintRects.push_back(rect);
+        }
+        if (m_paintRects.size() > MaxPaintRects)
+        {
+            // Many small pieces: one pass over their box queries and clips less
+            wxRect area = updated;
+            area.SetPosition(CalcUnscrolledPosition(area.GetPosition()));
+            m_paintRects.assign(1, area);
+        }
+        PaintAreas(dc, m_paintRects.data(), m_paintRects.size());
 
-    // Draw items
-    for (auto& item : m_items)
+        // Figures of the last frame that was more than the overlay repainting itself
+        if (m_profilerOverlay)
+        {
+            if (!overlay.Contains(updated))
+                m_overlayFrame = SvgProfiler::Get().GetLastFrame();
+            DrawProfilerOverlay(dc, CalcUnscrolledPosition(overlay.GetPosition()));
+        }
+    }
+
+    // The paint was clipped to the update region: show the new figures on the
+    // rest of the overlay now, over the window, rather than by another paint
+    if (m_profilerOverlay && !updated.Contains(overlay) && !overlay.Contains(updated))
     {
-        if (!item->visible) continue;
+        if (wxClientDC::CanBeUsedForDrawing(this))
+        {
+            wxClientDC dc(this);
+            DrawProfilerOverlay(dc, overlay.GetPosition());
+        }
+        else
+            RefreshRect(overlay, false);
+    }
+}
+
+void SvgCanvas::PaintAreas(wxDC& dc, const wxRect* areas, size_t count)
+{
+    SvgProfiler& profiler = SvgProfiler::Get();
+    profiler.BeginFrame();
+    unsigned shown = 0;
+    unsigned rendered = 0;
+    unsigned blitted = 0;
+
+    if (m_atlas)
+        m_atlas->BeginFrame();
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const wxRect& area = areas[i];
+
+        // clip to the area and clear just that
+        dc.SetClippingRegion(area);
 
-        // compute scaled size
-        int w = static_cast<int>(std::round(item->baseSize.GetWidth() * m_zoom));
-        int h = static_cast<int>(std::round(item->baseSize.GetHeight() * m_zoom));
+        dc.SetPen(*wxTRANSPARENT_PEN);
+        dc.SetBrush(*wxWHITE_BRUSH);
+        dc.DrawRectangle(area);
+        dc.SetPen(*wxBLACK_PEN);
 
-        // Logical position to device (dc coordinates use scrolled coords already)
-        wxPoint deviceTopLeft = item->pos;
-        // Render item if needed
-        wxBitmap bmp = item->svg.GetCachedBitmap(w, h, m_zoom);
-        if (!bmp.IsOk() || item->svg.IsDirty())
+        QueryItems(area);
+        std::sort(m_queryItems.begin(), m_queryItems.end(),
+                  [this](uint32_t a, uint32_t b) { return m_items.GetZOrder(a) < m_items.GetZOrder(b); });
+        const bool indexStale = m_indexZoom != m_zoom;
+
+        // Draw items
+        for (uint32_t slot : m_queryItems)
         {
-            bmp = item->svg.Render(w, h, m_zoom);
+            if (!m_items.IsVisible(slot)) continue;
+            if (indexStale && !GetItemBounds(slot).Intersects(area)) continue;
+            const unsigned rendersBefore = m_paintRenders;
+            ++shown;
+            if (count > 1 && profiler.IsEnabled())
+                m_paintShown.push_back(slot);
+
+            // compute scaled size
+            const wxSize size = GetItemSize(slot);
+            const int w = size.x;
+            const int h = size.y;
+
+            // Logical position to device (dc coordinates use scrolled coords already)
+            wxPoint deviceTopLeft = m_items.GetPos(slot);
+
+            // A few pixels wide: a stand-in shows as much, and the label is unreadable
+            const int side = std::max(w, h);
+            const bool showLabel = m_items.GetLabelSize(slot).x > 0 && side >= m_lod.labelSide;
+
+            SvgItem& item = m_items.GetItem(slot);
+            bool drawn;
+            if (side < m_lod.proxySide)
+            {
+                drawn = DrawLodProxy(dc, item, wxRect(deviceTopLeft, size));
+            }
+            else if (side < m_lod.thumbnailSide)
+            {
+                drawn = DrawLodThumbnail(dc, slot, wxRect(deviceTopLeft, size));
+            }
+            else if (IsTiled(size))
+            {
+                // Far too big for one bitmap: only the tiles under the repainted area
+                drawn = DrawTiledItem(dc, slot, wxRect(deviceTopLeft, size), area);
+            }
+            else if (m_atlas && SvgBitmapAtlas::Accepts(w, h) && DrawFromAtlas(dc, item, deviceTopLeft, size))
+            {
+                profiler.Count(SvgProfiler::CacheHits);
+                drawn = true;
+            }
+            else
+            {
+                // Render item if needed
+                wxBitmap bmp = item.svg.GetCachedBitmap(w, h, m_zoom);
+                bool current = bmp.IsOk(); // exact size, current content
+                profiler.Count(current ? SvgProfiler::CacheHits : SvgProfiler::CacheMisses);
+                if (!bmp.IsOk())
+                {
+                    // While zooming, whatever was rendered before, scaled to fit: every
+                    // size the gesture passes through is obsolete by the next step
+                    wxBitmap nearest = item.svg.GetNearestBitmap(w, h);
+                    if (m_zoomSettling)
+                        bmp = nearest.IsOk() ? nearest : item.svg.GetLastBitmap();
+                    else if (m_asyncRender)
+                    {
+                        // Never block paint on rasterization: queue it and show what we have
+                        RequestRender(slot, w, h);
+                        bmp = nearest.IsOk() ? nearest : item.svg.GetLastBitmap();
+                    }
+                    else
+                    {
+                        bmp = item.svg.Render(w, h, m_zoom);
+                        current = bmp.IsOk();
+                        ++m_paintRenders;
+                    }
+                }
+
+                drawn = bmp.IsOk();
+                if (drawn)
+                {
+                    if (bmp.GetWidth() == w && bmp.GetHeight() == h)
+                        dc.DrawBitmap(bmp, deviceTopLeft.x, deviceTopLeft.y, true);
+                    else
+                        DrawBitmapScaled(dc, bmp, wxRect(deviceTopLeft, wxSize(w, h)));
+
+                    // From the next paint on, drawn from a shared page
+                    if (m_atlas && current && SvgBitmapAtlas::Accepts(w, h))
+                        MoveToAtlas(item, bmp);
+                }
+            }
+
+            if (drawn)
+            {
+                // Draw selection rectangle
+                if (m_items.GetHandle(slot) == m_selectedItem)
+                {
+                    wxPen selPen(*wxBLUE, 2);
+                    dc.SetPen(selPen);
+                    dc.SetBrush(*wxTRANSPARENT_BRUSH);
+                    dc.DrawRectangle(deviceTopLeft.x, deviceTopLeft.y, w, h);
+                }
+
+                // Label underneath, drawn after every icon
+                if (showLabel)
+                    m_paintLabels.emplace_back(wxPoint(deviceTopLeft.x, deviceTopLeft.y + h + 4), slot);
+            }
+            else
+            {
+                // draw placeholder rectangle
+                dc.SetBrush(*wxLIGHT_GREY_BRUSH);
+                dc.DrawRectangle(deviceTopLeft.x, deviceTopLeft.y, std::max(10, w), std::max(10, h));
+                if (showLabel)
+                    m_paintLabels.emplace_back(wxPoint(deviceTopLeft.x, deviceTopLeft.y + h + 4), slot);
+            }
+
+            if (m_paintRenders != rendersBefore)
+                ++rendered;
+            else if (drawn)
+                ++blitted;
         }
 
-        if (bmp.IsOk())
+        // Labels in a second pass, each a blit of a cached rendering: no text layout
+        if (!m_paintLabels.empty())
         {
-            dc.DrawBitmap(bmp, deviceTopLeft.x, deviceTopLeft.y, true);
+            SvgProfileScope profileLabels("labels");
+            const wxFont font = GetFont();
+            const wxColour colour = dc.GetTextForeground();
+            for (const auto& label : m_paintLabels)
+            {
+                const wxBitmap& bmp = m_labelCache.Get(m_items.GetItem(label.second).label, font, colour);
+                if (bmp.IsOk())
+                    dc.DrawBitmap(bmp, label.first.x, label.first.y, true);
+            }
+            m_paintLabels.clear();
+        }
+
+        dc.DestroyClippingRegion();
+    }
+
+    // The scaled render may be replaced or patched before the next paint
+    if (m_scaleDCBitmap.IsOk())
+    {
+        m_scaleDC.SelectObjectAsSource(wxNullBitmap);
+        m_scaleDCBitmap = wxBitmap();
+    }
+
+    if (m_bitmapCache->IsOverBudget())
+        TrimBitmapCache();
+
+    if (profiler.IsEnabled())
+    {
+        profiler.Count(SvgProfiler::Rendered, rendered);
+        profiler.Count(SvgProfiler::Blitted, blitted);
+        // An item across two rectangles is drawn in both but shown once
+        if (count > 1)
+        {
+            std::sort(m_paintShown.begin(), m_paintShown.end());
+            shown = static_cast<unsigned>(std::unique(m_paintShown.begin(), m_paintShown.end()) - m_paintShown.begin());
+            m_paintShown.clear();
+        }
+        const unsigned total = static_cast<unsigned>(m_items.GetCount());
+        profiler.Count(SvgProfiler::Culled, total > shown ? total - shown : 0);
+    }
+    profiler.EndFrame();
+
+    // Buffer pool activity since the previous frame
+    const SvgRenderBufferPool::Stats buffers = SvgRenderBufferPool::Get().GetStats();
+    m_frameBuffers = buffers;
+    m_frameBuffers.acquires -= m_lastBuffers.acquires;
+    m_frameBuffers.allocations -= m_lastBuffers.allocations;
+    m_frameBuffers.frees -= m_lastBuffers.frees;
+    m_lastBuffers = buffers;
+}
 
-            // Draw selection rectangle
-            if (item.get() == m_selectedItem)
+bool SvgCanvas::DrawTiledItem(wxDC& dc, uint32_t slot, const wxRect& rect, const wxRect& area)
+{
+    const wxRect visible = rect.Intersect(area);
+    if (visible.IsEmpty())
+        return true; // only the label is being repainted
+
+    SvgItem& item = m_items.GetItem(slot);
+    const int tile = SvgImageLuna::TileSize;
+    const int firstCol = (visible.x - rect.x) / tile;
+    const int lastCol = (visible.GetRight() - rect.x) / tile;
+    const int firstRow = (visible.y - rect.y) / tile;
+    const int lastRow = (visible.GetBottom() - rect.y) / tile;
+
+    wxBitmap standIn;
+    bool standInLooked = false;
+    bool drawn = false;
+    for (int row = firstRow; row <= lastRow; ++row)
+    {
+        for (int col = firstCol; col <= lastCol; ++col)
+        {
+            wxRect tileRect = SvgImageLuna::GetTileRect(rect.width, rect.height, col, row);
+
+            wxBitmap bmp = item.svg.GetCachedTile(rect.width, rect.height, col, row);
+            SvgProfiler::Get().Count(bmp.IsOk() ? SvgProfiler::CacheHits : SvgProfiler::CacheMisses);
+            if (!bmp.IsOk() && !m_zoomSettling)
             {
-                wxPen selPen(*wxBLUE, 2);
-                dc.SetPen(selPen);
-                dc.SetBrush(*wxTRANSPARENT_BRUSH);
-                dc.DrawRectangle(deviceTopLeft.x, deviceTopLeft.y, w, h);
+                if (m_asyncRender)
+                    RequestRender(slot, rect.width, rect.height, col, row);
+                else
+                {
+                    bmp = item.svg.RenderTile(rect.width, rect.height, col, row);
+                    ++m_paintRenders;
+                }
             }
 
-            // Draw label underneath
-            if (!item->label.IsEmpty())
+            if (bmp.IsOk())
             {
-                wxFont f = dc.GetFont();
-                dc.SetFont(f);
-                int tx = deviceTopLeft.x;
-                int ty = deviceTopLeft.y + bmp.GetHeight() + 4;
-                dc.DrawText(item->label, tx, ty);
+                dc.DrawBitmap(bmp, rect.x + tileRect.x, rect.y + tileRect.y, true);
+                drawn = true;
+                continue;
             }
+
+            // Meanwhile the matching part of a whole-image level, scaled up
+            if (!standInLooked)
+            {
+                standIn = GetTileStandIn(slot, rect.GetSize());
+                standInLooked = true;
+            }
+            if (!standIn.IsOk())
+                continue;
+
+            const double sx = double(standIn.GetWidth()) / rect.width;
+            const double sy = double(standIn.GetHeight()) / rect.height;
+            wxRect src(static_cast<int>(tileRect.x * sx), static_cast<int>(tileRect.y * sy),
+                       std::max(1, static_cast<int>(std::round(tileRect.width * sx))),
+                       std::max(1, static_cast<int>(std::round(tileRect.height * sy))));
+            src.Intersect(wxRect(wxPoint(0, 0), standIn.GetSize()));
+            tileRect.Offset(rect.GetPosition());
+            DrawBitmapScaled(dc, standIn, tileRect, src);
+            drawn = true;
         }
-        else
+    }
+    return drawn;
+}
+
+bool SvgCanvas::DrawLodThumbnail(wxDC& dc, uint32_t slot, const wxRect& rect)
+{
+    SvgItem& item = m_items.GetItem(slot);
+    const wxSize thumb = item.svg.GetThumbnailSize(m_lod.thumbnailSide);
+    wxBitmap bmp = item.svg.GetCachedBitmap(thumb.x, thumb.y, m_zoom);
+    SvgProfiler::Get().Count(bmp.IsOk() ? SvgProfiler::CacheHits : SvgProfiler::CacheMisses);
+    if (!bmp.IsOk())
+    {
+        if (m_asyncRender)
         {
-            // draw placeholder rectangle
-            dc.SetBrush(*wxLIGHT_GREY_BRUSH);
-            dc.DrawRectangle(deviceTopLeft.x, deviceTopLeft.y, std::max(10, w), std::max(10, h));
-            if (!item->label.IsEmpty())
-                dc.DrawText(item->label, deviceTopLeft.x, deviceTopLeft.y + h + 4);
+            // The colour proxy until the thumbnail arrives
+            RequestRender(slot, thumb.x, thumb.y);
+            return DrawLodProxy(dc, item, rect);
         }
+        bmp = item.svg.Render(thumb.x, thumb.y, m_zoom);
+        ++m_paintRenders;
+        if (!bmp.IsOk())
+            return false;
+    }
+
+    // Items showing the same document share the thumbnail
+    DrawBitmapScaled(dc, bmp, rect);
+    return true;
+}
+
+bool SvgCanvas::DrawLodProxy(wxDC& dc, SvgItem& item, const wxRect& rect)
+{
+    uint32_t argb;
+    if (!item.svg.GetAverageColor(argb))
+        return false;
+
+    // Premultiplied, so over the white background each channel is c + (255 - alpha)
+    const unsigned transparency = 255 - (argb >> 24);
+    const wxColour colour(static_cast<unsigned char>(((argb >> 16) & 0xff) + transparency),
+                          static_cast<unsigned char>(((argb >> 8) & 0xff) + transparency),
+                          static_cast<unsigned char>((argb & 0xff) + transparency));
+    dc.SetPen(*wxTRANSPARENT_PEN);
+    dc.SetBrush(*wxTheBrushList->FindOrCreateBrush(colour));
+    dc.DrawRectangle(rect);
+    dc.SetPen(*wxBLACK_PEN);
+    return true;
+}
+
+wxBitmap SvgCanvas::GetTileStandIn(uint32_t slot, const wxSize& size)
+{
+    SvgItem& item = m_items.GetItem(slot);
+    wxBitmap bmp = item.svg.GetNearestBitmap(size.x, size.y);
+    if (bmp.IsOk())
+        return bmp;
+    if (m_zoomSettling)
+        return item.svg.GetLastBitmap(); // mid-gesture: no preview render for a passing size
+
+    // A small whole-image render also serves as the item's hit mask
+    const wxSize preview = GetPreviewSize(size);
+    if (m_asyncRender)
+    {
+        RequestRender(slot, preview.x, preview.y);
+        return item.svg.GetLastBitmap();
     }
+    ++m_paintRenders;
+    return item.svg.Render(preview.x, preview.y, m_zoom);
+}
+
+wxSize SvgCanvas::GetPreviewSize(const wxSize& size)
+{
+    const double scale = std::min(1.0, double(TilePreviewMaxSide) / std::max(size.x, size.y));
+    return wxSize(std::max(1, static_cast<int>(std::round(size.x * scale))),
+                  std::max(1, static_cast<int>(std::round(size.y * scale))));
 }
 
 wxPoint SvgCanvas::ScreenToLogical(const wxPoint& pt) const
@@ -150,83 +969,104 @@ wxPoint SvgCanvas::LogicalToScreen(const wxPoint& pt) const
 
 
 // Pixel-perfect hit test: check bitmap alpha at local point
-SvgItem* SvgCanvas::HitTest(const wxPoint& logicalPt, wxPoint* hitLocalOut)
+SvgItemHandle SvgCanvas::HitTest(const wxPoint& logicalPt, wxPoint* hitLocalOut)
 {
-    // iterate in reverse order to prefer topmost
-    for (auto it = m_items.rbegin(); it != m_items.rend(); ++it)
+    SvgProfileScope profile("hit_test");
+
+    // only items indexed under the point are candidates
+    m_queryItems.clear();
+    if (m_indexZoom == m_zoom)
+        m_index.Query(logicalPt, m_queryItems);
+    else
+        m_index.Query(GetIndexQueryArea(wxRect(logicalPt, wxSize(1, 1))), m_queryItems);
+
+    // iterate topmost first
+    std::sort(m_queryItems.begin(), m_queryItems.end(),
+              [this](uint32_t a, uint32_t b) { return m_items.GetZOrder(a) > m_items.GetZOrder(b); });
+
+    for (uint32_t slot : m_queryItems)
     {
-        SvgItem* item = it->get();
-        if (!item->visible) continue;
-        int w = static_cast<int>(std::round(item->baseSize.GetWidth() * m_zoom));
-        int h = static_cast<int>(std::round(item->baseSize.GetHeight() * m_zoom));
-        wxRect rect(item->pos, wxSize(w, h));
+        if (!m_items.IsVisible(slot)) continue;
+        const wxSize size = GetItemSize(slot);
+        const int w = size.x;
+        const int h = size.y;
+        const wxPoint pos = m_items.GetPos(slot);
+        wxRect rect(pos, size);
         if (!rect.Contains(logicalPt)) continue;
 
         // local coordinates within bitmap
-        int lx = logicalPt.x - item->pos.x;
-        int ly = logicalPt.y - item->pos.y;
+        int lx = logicalPt.x - pos.x;
+        int ly = logicalPt.y - pos.y;
         if (lx < 0 || ly < 0 || lx >= w || ly >= h) continue;
 
-        // get cached or render the bitmap temporarily (no cache mutation here)
-        wxBitmap bmp = item->svg.GetCachedBitmap(w, h, m_zoom);
-        if (!bmp.IsOk())
-            bmp = item->svg.Render(w, h, m_zoom);
-
-        if (!bmp.IsOk()) continue;
+        SvgItem& item = m_items.GetItem(slot);
 
-        wxImage img = bmp.ConvertToImage();
-        if (!img.HasAlpha())
+        // Test the hit mask built alongside the best matching render. In sync mode render
+        // once if nothing was ever rendered (just the preview of a tiled item); async
+        // mode never rasterizes here.
+        if (!item.svg.GetHitMask(w, h) && !m_asyncRender)
         {
-            // If no alpha, treat entire rect as hit
-            if (hitLocalOut) *hitLocalOut = wxPoint(lx, ly);
-            return item;
+            const wxSize renderSize = IsTiled(size) ? GetPreviewSize(size) : size;
+            item.svg.Render(renderSize.x, renderSize.y, m_zoom);
         }
 
-        unsigned char alpha = img.GetAlpha(lx, ly);
-        if (alpha > 10) // threshold
+        bool hit;
+        if (!item.svg.GetHitMask(w, h))
+            hit = m_asyncRender; // nothing rendered yet: fall back to the bounding box
+        else
+            hit = item.svg.HitTestLocal(lx, ly, w, h, IsTiled(size));
+
+        if (hit)
         {
             if (hitLocalOut) *hitLocalOut = wxPoint(lx, ly);
-            return item;
+            return m_items.GetHandle(slot);
         }
     }
-    return nullptr;
+    return SvgItemHandle();
 }
 
 void SvgCanvas::OnLeftDown(wxMouseEvent& evt)
 {
+    // Hit testing and dragging want the index at the zoom on screen
+    if (m_zoomSettling)
+        SettleZoom();
+
     wxPoint logical = ScreenToLogical(evt.GetPosition());
     wxPoint local;
     auto hit = HitTest(logical, &local);
 
-    if (hit)
+    // Only the old and new selection frames need repainting
+    if (m_items.IsValid(m_selectedItem) && m_selectedItem != hit)
+        RefreshItem(m_selectedItem.slot);
+
+    if (hit.IsOk())
     {
         // Set the clicked SVG as selected
         m_selectedItem = hit;
 
         // Start dragging
-        m_dragItem = std::shared_ptr<SvgItem>(hit, [](SvgItem*){ /* non-owning */ });
+        m_dragItem = hit;
         m_dragOffset = wxPoint(local.x, local.y);
 
         CaptureMouse();
 
-        Refresh(false); // optional: redraw selection rectangle
+        RefreshItem(hit.slot); // redraw selection rectangle
     }
     else
     {
         // Clicked empty space → clear selection
-        m_selectedItem = nullptr;
+        m_selectedItem = SvgItemHandle();
         evt.Skip();
-        Refresh(false);
     }
 }
 
 
 void SvgCanvas::OnLeftUp(wxMouseEvent& evt)
 {
-    if (m_dragItem && HasCapture())
+    if (m_dragItem.IsOk() && HasCapture())
     {
         ReleaseMouse();
-        m_dragItem.reset();
+        m_dragItem = SvgItemHandle();
     }
     else
         evt.Skip();
@@ -236,33 +1076,39 @@ void SvgCanvas::OnMouseMove(wxMouseEvent& evt)
 {
     wxPoint logical = ScreenToLogical(evt.GetPosition());
 
-    if (m_dragItem)
+    if (m_items.IsValid(m_dragItem))
     {
+        const uint32_t slot = m_dragItem.slot;
+
         // Update item position to keep the offset constant
         wxPoint newTopLeft(logical.x - m_dragOffset.x, logical.y - m_dragOffset.y);
-        m_dragItem->pos = newTopLeft;
+        if (newTopLeft == m_items.GetPos(slot))
+            return;
+
+        // Repaint only where the item (with label and selection frame) was and now is
+        wxRect dirty = GetItemBounds(slot);
+        m_items.SetPos(slot, newTopLeft);
+        dirty.Union(GetItemBounds(slot));
+
+        UpdateItemIndex(slot);
         UpdateVirtualSize();
-        Refresh(false);
+        RefreshLogicalRect(dirty);
         return;
     }
 
     if (m_panning && evt.Dragging() && evt.RightIsDown())
     {
-        // Panning: adjust view start based on mouse movement
-        wxPoint cur = GetViewStart();
-        // Compute delta in pixels between anchor and current mouse
-        // We will simulate moving view by changing scroll start
-        // Simpler: use Scroll and track difference
-        // But here we'll compute delta in pixels:
-        // dx = anchor.x - logical.x; dy = anchor.y - logical.y
-        // Convert to scroll units
-        wxPoint curPixels = GetViewStart();
-        // Not necessary complicated: call Scroll with appropriate units
-        // We'll compute pixel difference relative to last known pan anchor
-        // For simplicity we just Scroll by -delta/scrollRate
-        // NOTE: Keep it simple: use Screen coords for panning movement
+        // The canvas follows the mouse: client coordinates stay put while it scrolls
+        m_panTarget = m_panStartView + (m_panAnchor - evt.GetPosition());
 
-        // We'll handle panning in OnRightDrag - simpler approach
+        // First move of a frame scrolls now; the rest of the frame's motion is
+        // taken up when the timer fires
+        if (!m_panTimer.IsRunning())
+        {
+            ApplyPan();
+            m_panTimer.StartOnce(PanFrameMs);
+        }
+        return;
     }
 
     evt.Skip();
@@ -270,9 +1116,14 @@ void SvgCanvas::OnMouseMove(wxMouseEvent& evt)
 
 void SvgCanvas::OnRightDown(wxMouseEvent& evt)
 {
+    int unitX, unitY;
+    GetScrollPixelsPerUnit(&unitX, &unitY);
+    const wxPoint view = GetViewStart();
+
     m_panning = true;
-    m_panAnchor = ScreenToLogical(evt.GetPosition());
-    m_panStartView = GetViewStart();
+    m_panAnchor = evt.GetPosition();
+    m_panStartView = wxPoint(view.x * unitX, view.y * unitY);
+    m_panTarget = m_panStartView;
     CaptureMouse();
 }
 
@@ -280,11 +1131,52 @@ void SvgCanvas::OnRightUp(wxMouseEvent& evt)
 {
     if (m_panning)
     {
+        // Land where the mouse was let go, not where the last frame left it
+        m_panTimer.Stop();
+        ApplyPan();
         m_panning = false;
         if (HasCapture()) ReleaseMouse();
     }
 }
 
+void SvgCanvas::OnPanFrame(wxTimerEvent& WXUNUSED(evt))
+{
+    // Keep the frame rate while the mouse keeps moving; once it rests the next
+    // motion scrolls at once
+    if (m_panning && ApplyPan())
+        m_panTimer.StartOnce(PanFrameMs);
+}
+
+bool SvgCanvas::ApplyPan()
+{
+    int unitX, unitY;
+    GetScrollPixelsPerUnit(&unitX, &unitY);
+    const wxPoint view = GetViewStart();
+
+    // Nearest scroll unit; Scroll() clamps to the scrollable range
+    const wxPoint target(unitX > 0 ? (std::max(0, m_panTarget.x) + unitX / 2) / unitX : view.x,
+                         unitY > 0 ? (std::max(0, m_panTarget.y) + unitY / 2) / unitY : view.y);
+    if (target == view)
+        return false;
+
+    // Moves what is on screen and invalidates the exposed strips (ScrollWindow);
+    // painting them now keeps the frame whole
+    Scroll(target);
+    if (GetViewStart() == view)
+        return false;
+    Update();
+    return true;
+}
+
+void SvgCanvas::ScrollWindow(int dx, int dy, const wxRect* rect)
+{
+    wxScrolledWindow::ScrollWindow(dx, dy, rect);
+
+    // The overlay sits still in the client area, the blit moved a copy of it
+    if (m_profilerOverlay)
+        RefreshRect(GetProfilerOverlayRect(), false);
+}
+
 void SvgCanvas::OnMouseWheel(wxMouseEvent& evt)
 {
     // Ctrl + wheel -> zoom
@@ -333,24 +1225,305 @@ void SvgCanvas::OnMouseWheel(wxMouseEvent& evt)
     }
 }
 
-void SvgCanvas::UpdateVirtualSize()
+void SvgCanvas::RefreshLogicalRect(const wxRect& rect)
+{
+    wxRect device(rect);
+    device.SetPosition(CalcScrolledPosition(rect.GetPosition()));
+    RefreshRect(device, false);
+}
+
+void SvgCanvas::UpdateItemIndex(uint32_t slot)
+{
+    const bool visible = m_items.IsVisible(slot);
+    if (visible)
+        UntrackItemBounds(slot);
+
+    // At the zoom the rest of the index is at, which lags behind during a zoom gesture
+    m_items.UpdateBounds(slot, m_indexZoom);
+    m_index.Update(slot, m_items.GetBounds(slot));
+
+    if (visible)
+        TrackItemBounds(slot);
+}
+
+void SvgCanvas::RebuildIndex()
 {
-    // Compute bounding box of all items
-    int maxX = 0;
-    int maxY = 0;
-    for (auto& it : m_items)
+    // every extent changes with the zoom: one pass over the bounds columns, then
+    // the extent filled from sorted edges, each inserted at the end in O(1)
+    m_indexZoom = m_zoom;
+    m_items.UpdateAllBounds(m_zoom);
+
+    std::vector<int> rights;
+    std::vector<int> bottoms;
+    rights.reserve(m_items.GetCount());
+    bottoms.reserve(m_items.GetCount());
+    for (uint32_t slot = 0; slot < m_items.GetSlotCount(); ++slot)
     {
-        if (!it->visible) continue;
-        int w = static_cast<int>(std::round(it->baseSize.GetWidth() * m_zoom));
-        int h = static_cast<int>(std::round(it->baseSize.GetHeight() * m_zoom));
-        maxX = std::max(maxX, it->pos.x + w);
-        maxY = std::max(maxY, it->pos.y + h + m_labelHeight);
+        if (!m_items.IsLive(slot))
+            continue;
+        m_index.Update(slot, m_items.GetBounds(slot));
+        if (m_items.IsVisible(slot))
+        {
+            rights.push_back(m_items.GetBoundsRight(slot));
+            bottoms.push_back(m_items.GetBoundsBottom(slot));
+        }
     }
 
+    std::sort(rights.begin(), rights.end());
+    std::sort(bottoms.begin(), bottoms.end());
+    m_sceneRights.clear();
+    m_sceneBottoms.clear();
+    for (int right : rights)
+        m_sceneRights.insert(m_sceneRights.end(), right);
+    for (int bottom : bottoms)
+        m_sceneBottoms.insert(m_sceneBottoms.end(), bottom);
+}
+
+void SvgCanvas::TrackItemBounds(uint32_t slot)
+{
+    // Label included, so the scroll area reaches the end of a wide label
+    m_sceneRights.insert(m_items.GetBoundsRight(slot));
+    m_sceneBottoms.insert(m_items.GetBoundsBottom(slot));
+}
+
+void SvgCanvas::UntrackItemBounds(uint32_t slot)
+{
+    m_sceneRights.erase(m_sceneRights.find(m_items.GetBoundsRight(slot)));
+    m_sceneBottoms.erase(m_sceneBottoms.find(m_items.GetBoundsBottom(slot)));
+}
+
+void SvgCanvas::QueryItems(const wxRect& area)
+{
+    const wxRect query = GetIndexQueryArea(area);
+    m_queryItems.clear();
+
+    // Taking in half the scene or more (zoomed out, a full repaint of a small
+    // scene), scanning the bounds columns beats visiting every grid cell
+    const long long scene = static_cast<long long>(m_virtualSize.x) * m_virtualSize.y;
+    if (static_cast<long long>(query.width) * query.height * 2 >= scene)
+        m_items.Cull(query, m_queryItems);
+    else
+        m_index.Query(query, m_queryItems);
+}
+
+void SvgCanvas::SetItemVisible(SvgItemHandle handle, bool visible)
+{
+    if (!m_items.IsValid(handle) || m_items.IsVisible(handle.slot) == visible)
+        return;
+
+    const uint32_t slot = handle.slot;
+    if (visible)
+    {
+        m_items.SetVisible(slot, true);
+        TrackItemBounds(slot);
+    }
+    else
+    {
+        UntrackItemBounds(slot);
+        m_items.SetVisible(slot, false);
+    }
+    UpdateVirtualSize();
+    RefreshItem(slot);
+}
+
+void SvgCanvas::SetItemLabel(SvgItemHandle handle, const wxString& label)
+{
+    SvgItem* item = m_items.Get(handle);
+    if (!item || item->label == label)
+        return;
+
+    // The old extent, then the new one; the old rendering ages out of the label cache
+    const uint32_t slot = handle.slot;
+    RefreshItem(slot);
+    item->label = label;
+    m_items.SetLabelSize(slot, label.IsEmpty() ? wxSize() : GetTextExtent(label));
+    UpdateItemIndex(slot);
+    UpdateVirtualSize();
+    RefreshItem(slot);
+}
+
+bool SvgCanvas::SetFont(const wxFont& font)
+{
+    if (!wxScrolledWindow::SetFont(font))
+        return false;
+
+    // Every label changes size; renderings in the old font are no use any more
+    m_labelCache.Clear();
+    for (uint32_t slot = 0; slot < m_items.GetSlotCount(); ++slot)
+    {
+        if (!m_items.IsLive(slot))
+            continue;
+        const wxString& label = m_items.GetItem(slot).label;
+        m_items.SetLabelSize(slot, label.IsEmpty() ? wxSize() : GetTextExtent(label));
+    }
+    RebuildIndex();
+    UpdateVirtualSize();
+    Refresh(false);
+    return true;
+}
+
+void SvgCanvas::UpdateVirtualSize()
+{
+    // Bounding box of all visible items, kept up to date by TrackItemBounds()
+    int maxX = m_sceneRights.empty() ? 0 : std::max(0, *m_sceneRights.rbegin());
+    int maxY = m_sceneBottoms.empty() ? 0 : std::max(0, *m_sceneBottoms.rbegin());
+
     // Some minimum size
     maxX += 20;
     maxY += 20;
 
+    const wxSize size(maxX, maxY);
+    if (size == m_virtualSize)
+        return;
+
+    m_virtualSize = size;
     SetVirtualSize(maxX, maxY);
 }
 
+
+void SvgCanvas::RequestRender(uint32_t slot, int w, int h, int col, int row)
+{
+    if (!m_renderPool)
+        return;
+
+    SvgItem& item = m_items.GetItem(slot);
+    auto document = item.svg.GetDocument();
+    if (!document)
+        return;
+
+    // Counted only once actually queued: an item waiting on its render is not rendered again
+    if (!m_items.AddPendingRender(slot, col, row))
+        return;
+    ++m_paintRenders;
+
+    const SvgItemHandle handle = m_items.GetHandle(slot);
+    auto documentMutex = item.svg.GetDocumentMutex();
+    const unsigned generation = item.svg.GetGeneration();
+
+    SvgDiskCache::Key diskKey;
+    std::shared_ptr<SvgDiskCache> diskCache;
+    if (item.svg.GetDiskCache() && item.svg.GetDiskCacheKey(w, h, col, row, diskKey))
+        diskCache = item.svg.GetDiskCache();
+
+    // The task owns the document and its mutex, never the item itself, so an item
+    // removed meanwhile is never destroyed on a worker thread; the handle tells
+    // the UI thread whether it is still there.
+    m_renderPool->Submit([this, handle, document, documentMutex, diskCache, diskKey, w, h, col, row, generation]()
+    {
+        std::unique_ptr<CompletedRender> done(new CompletedRender);
+        done->item = handle;
+        done->width = w;
+        done->height = h;
+        done->col = col;
+        done->row = row;
+        done->generation = generation;
+
+        // Raw pixels either way, which the UI thread writes straight into the
+        // bitmap. A disk cache hit needs no document lock.
+        if (!diskCache || !diskCache->Load(diskKey, done->stored))
+        {
+            bool ok;
+            {
+                std::lock_guard<std::mutex> lock(*documentMutex);
+                ok = SvgImageLuna::Rasterize(*document, w, h, col, row, done->pixels);
+            }
+            if (ok && diskCache)
+                diskCache->Save(diskKey, done->pixels.GetBitmap());
+        }
+
+        bool queueDrain = false;
+        {
+            std::lock_guard<std::mutex> lock(m_completedMutex);
+            m_completed.push_back(std::move(done));
+            queueDrain = !m_drainQueued;
+            m_drainQueued = true;
+        }
+        // One UI event drains every result finished in the meantime
+        if (queueDrain)
+            CallAfter(&SvgCanvas::DrainCompletedRenders);
+    });
+}
+
+bool SvgCanvas::HasPendingRenders() const
+{
+    // Items stay pending until their result is drained
+    return m_items.HasPendingRenders();
+}
+
+void SvgCanvas::CancelPendingRenders()
+{
+    if (!m_renderPool)
+        return;
+
+    // Jobs already running still deliver (and are dropped if stale); queued ones go away
+    m_renderPool->CancelPending();
+    m_items.ClearPendingRenders();
+}
+
+void SvgCanvas::DrainCompletedRenders()
+{
+    std::vector<std::unique_ptr<CompletedRender>> completed;
+    {
+        std::lock_guard<std::mutex> lock(m_completedMutex);
+        completed.swap(m_completed);
+        m_drainQueued = false;
+    }
+
+    for (auto& done : completed)
+    {
+        SvgItem* item = m_items.Get(done->item);
+        if (!item)
+            continue; // removed while rendering
+
+        // A result superseded by an edit is dropped; repainting the item then
+        // queues a fresh render. Either way only the icon area (or the tile) needs repainting.
+        if (done->col >= 0)
+        {
+            m_items.RemovePendingRender(done->item.slot, done->col, done->row);
+            item->svg.AcceptPixels(done->GetPixels(), done->width, done->height, done->col, done->row, done->generation);
+
+            wxRect tileRect = SvgImageLuna::GetTileRect(done->width, done->height, done->col, done->row);
+            tileRect.Offset(m_items.GetPos(done->item.slot));
+            RefreshLogicalRect(tileRect);
+            continue;
+        }
+
+        m_items.RemovePendingRender(done->item.slot, -1, -1);
+        item->svg.AcceptPixels(done->GetPixels(), done->width, done->height, -1, -1, done->generation);
+
+        RefreshItem(done->item.slot);
+    }
+}
+
+void SvgCanvas::TrimBitmapCache()
+{
+    // Pin whatever is on screen, not just the repainted area, so an evicted
+    // bitmap is never one that the next partial repaint needs again
+    wxRect visible(CalcUnscrolledPosition(wxPoint(0, 0)), GetClientSize());
+
+    QueryItems(visible);
+
+    m_bitmapCache->BeginPin();
+    for (uint32_t slot : m_queryItems)
+    {
+        const wxSize size = GetItemSize(slot);
+        m_bitmapCache->Pin(m_items.GetItem(slot).svg.GetCacheKey(), size.x, size.y);
+    }
+    m_bitmapCache->Trim();
+}
+
+void SvgCanvas::DrawBitmapScaled(wxDC& dc, const wxBitmap& bmp, const wxRect& dest)
+{
+    DrawBitmapScaled(dc, bmp, dest, wxRect(0, 0, bmp.GetWidth(), bmp.GetHeight()));
+}
+
+void SvgCanvas::DrawBitmapScaled(wxDC& dc, const wxBitmap& bmp, const wxRect& dest, const wxRect& src)
+{
+    if (!m_scaleDCBitmap.IsSameAs(bmp))
+    {
+        m_scaleDC.SelectObjectAsSource(bmp);
+        m_scaleDCBitmap = bmp;
+    }
+    dc.StretchBlit(dest.x, dest.y, dest.width, dest.height,
+                   &m_scaleDC, src.x, src.y, src.width, src.height, wxCOPY, true);
+}
@@ -2,35 +2,136 @@
 
 #include <wx/scrolwin.h>
 #include <wx/dcbuffer.h>
+#include <wx/dcmemory.h>
+#include <wx/timer.h>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include "svg_bitmap_atlas.h"
+#include "svg_bitmap_cache.h"
 #include "svg_image_luna.h"
-
-// Represents one item on the canvas
-struct SvgItem
-{
-    SvgImageLuna svg;    // svg doc + render cache
-    wxPoint pos;         // top-left position in virtual (logical) coordinates
-    wxSize  baseSize;    // base logical size (before zoom), e.g., {128,128}
-    wxString label;      // label to draw under icon
-    bool visible = true;
-
-    // Per-item convenience
-    bool IsPointInside(const wxPoint& logicalPt, double zoom) const;
-};
+#include "svg_item_store.h"
+#include "svg_label_cache.h"
+#include "svg_profiler.h"
+#include "svg_render_buffer.h"
+#include "svg_spatial_grid.h"
+#include "svg_worker_pool.h"
 
 class SvgCanvas : public wxScrolledWindow
 {
 public:
     SvgCanvas(wxWindow* parent);
+    ~SvgCanvas();
 
     // API
     bool AddSvgFile(const std::string& filePath, const wxPoint& pos, const wxSize& baseSize, const wxString& label = wxEmptyString);
+
+    struct FileEntry
+    {
+        std::string path;
+        wxPoint pos;
+        wxSize baseSize;
+        wxString label;
+    };
+
+    // Bulk load: all files are read and parsed in parallel on worker threads, then
+    // the items are added in order with one virtual-size update and one refresh.
+    // Returns the number of items added; indices of entries that failed to load
+    // are appended to 'failed' if given.
+    size_t AddSvgFiles(const std::vector<FileEntry>& entries, std::vector<size_t>* failed = nullptr);
     void Clear();
 
+    // Whole scene as a SvgSceneSnapshot file: every item's position, base size,
+    // label and visibility, plus each distinct source once with the edits made
+    // through SvgImageLuna::ApplyEdit(). Saving fails if a source whose text was
+    // released can no longer be read back from its file.
+    bool SaveScene(const std::string& filePath) const;
+
+    // Replace the scene with a saved one. Items are restored unparsed: each
+    // document is parsed when its item is first painted or accessed.
+    bool LoadScene(const std::string& filePath);
+
+    // DOM edits across one or many items, repainted together. Between BeginEdit()
+    // and CommitEdit() (or during a SvgEditTransaction) edits only record the area
+    // of the elements they change; the commit re-rasterizes just those areas of
+    // each item's cached renders and invalidates just the matching screen
+    // rectangles. Stylesheet edits and edits under a filter repaint the whole
+    // item. Transactions nest; the outermost commit repaints.
+    void BeginEdit();
+    size_t ApplyEdit(SvgItemHandle item, const SvgDomEdit& edit); // outside a transaction, commits at once
+    void CommitEdit();
+
+    // Items are referred to by handle; a handle to an item since removed (by
+    // Clear() or LoadScene()) resolves to nullptr and is ignored by every call
+    SvgItem* GetItem(SvgItemHandle item) const { return m_items.Get(item); }
+    SvgItemHandle GetSelectedItem() const { return m_items.IsValid(m_selectedItem) ? m_selectedItem : SvgItemHandle(); }
+
     // Query / operations
-    void SetZoom(double zoom); // sets zoom and marks items dirty to re-render at new size
+    // Zoom changes are a gesture: until no change came for ZoomSettleDelayMs, paint
+    // scales the renders items already have and rasterizes nothing; once settled,
+    // visible items render once at the final zoom
+    void SetZoom(double zoom);
     double GetZoom() const { return m_zoom; }
+    void SetItemVisible(SvgItemHandle item, bool visible);
+    void SetItemLabel(SvgItemHandle item, const wxString& label);
+
+    // Labels are drawn in this font; changing it re-measures every label
+    bool SetFont(const wxFont& font) override;
+
+    // Async mode: dirty items are rasterized on a worker pool while paint shows the
+    // last good bitmap (or a placeholder); finished bitmaps are swapped in with a
+    // targeted refresh. Off by default.
+    void SetAsyncRender(bool async);
+    bool IsAsyncRender() const { return m_asyncRender; }
+
+    // Memory budget (bytes, 0 = unlimited) shared by every item's rendered bitmaps.
+    // Past it, the least recently drawn bitmaps not currently visible are evicted.
+    void SetCacheBudget(size_t bytes);
+    size_t GetCacheBudget() const { return m_bitmapCache->GetBudget(); }
+    SvgBitmapCache::Stats GetCacheStats() const { return m_bitmapCache->GetStats(); }
+
+    // Atlas mode: whole-image renders of small items (up to SvgBitmapAtlas::MaxItemSide
+    // pixels a side at the current zoom) are moved into a few shared pages and drawn
+    // as sub-rectangle blits, so thousands of icons cost a handful of native bitmaps
+    // instead of one each. Off by default.
+    void SetAtlasMode(bool atlas);
+    bool IsAtlasMode() const { return m_atlas != nullptr; }
+    SvgBitmapAtlas::Stats GetAtlasStats() const { return m_atlas ? m_atlas->GetStats() : SvgBitmapAtlas::Stats(); }
+
+    // Render buffer pool activity between the last two painted frames (acquires,
+    // allocations, frees; byte counts are as of the last frame). Renders finished
+    // on workers count toward the frame that follows them. Once the pool is warm,
+    // allocations stay at zero while zooming between sizes already seen.
+    const SvgRenderBufferPool::Stats& GetFrameBufferStats() const { return m_frameBuffers; }
+
+    // Level of detail for zoomed-out views, by the larger side of an item on screen:
+    // below thumbnailSide pixels it is drawn from one small render of its document,
+    // scaled down; below proxySide as a rectangle in the document's average colour.
+    // Labels are skipped below labelSide. Thumbnails and colours are computed once
+    // per document and shared by every item showing it. 0 turns a tier off.
+    struct LodPolicy
+    {
+        int thumbnailSide;
+        int proxySide;
+        int labelSide;
+    };
+    enum { DefaultLodThumbnailSide = 24, DefaultLodProxySide = 8, DefaultLodLabelSide = 32 };
+
+    void SetLodPolicy(const LodPolicy& policy) { m_lod = policy; Refresh(false); }
+    const LodPolicy& GetLodPolicy() const { return m_lod; }
+
+    // Live profiler overlay in the top-left corner of the view: paint time, items
+    // rendered / blitted / culled, cache hit rate and rasterization time of the
+    // last frame (see SvgProfiler). Turning it on enables the profiler.
+    void SetProfilerOverlay(bool show);
+    bool IsProfilerOverlay() const { return m_profilerOverlay; }
+
+    // Optional on-disk cache of rendered bitmaps, so the next launch loads the
+    // renders of unchanged files instead of rasterizing them (nullptr = none)
+    void SetDiskCache(const std::shared_ptr<SvgDiskCache>& cache);
+    const std::shared_ptr<SvgDiskCache>& GetDiskCache() const { return m_diskCache; }
 
 protected:
     // paint, mouse, wheel handlers
@@ -42,37 +143,213 @@ protected:
     void OnRightDown(wxMouseEvent& evt);
     void OnRightUp(wxMouseEvent& evt);
     void OnMouseWheel(wxMouseEvent& evt);
+    void OnZoomSettled(wxTimerEvent& evt);
+    void SettleZoom(); // end a zoom gesture now: reindex at the final zoom and repaint
+    void OnPanFrame(wxTimerEvent& evt);
+    bool ApplyPan(); // scroll to m_panTarget; false if the view did not move
+
+    // Every scroll, by drag or scrollbar, moves the pixels already on screen and
+    // invalidates only the exposed strips; the overlay is repainted in place
+    void ScrollWindow(int dx, int dy, const wxRect* rect = nullptr) override;
+
+    // Draw everything intersecting 'area' (canvas coordinates) into a dc already
+    // prepared for scrolling. OnPaint passes the update region; offscreen callers
+    // such as the benchmarks pass any rectangle and a wxMemoryDC.
+    void PaintArea(wxDC& dc, const wxRect& area) { PaintAreas(dc, &area, 1); }
+    // Several rectangles in one frame, each cleared, drawn and clipped on its own
+    void PaintAreas(wxDC& dc, const wxRect* areas, size_t count);
 
     // helpers
     wxPoint ScreenToLogical(const wxPoint& pt) const;
     wxPoint LogicalToScreen(const wxPoint& pt) const;
-    SvgItem* HitTest(const wxPoint& logicalPt, wxPoint* hitLocalOut = nullptr);
+    SvgItemHandle HitTest(const wxPoint& logicalPt, wxPoint* hitLocalOut = nullptr);
 
     void UpdateVirtualSize();
 
-public:
-    SvgItem* GetSelectedSvg() { return m_selectedItem; }
+    // item geometry at the current zoom, by SvgItemStore slot
+    wxSize GetItemSize(uint32_t slot) const { return m_items.GetSize(slot, m_zoom); }
+    wxRect GetItemBounds(uint32_t slot) const { return m_items.ComputeBounds(slot, m_zoom); } // icon + label + selection frame
+
+    // invalidate a canvas-coordinate rectangle / one item's bounds
+    void RefreshLogicalRect(const wxRect& rect);
+    void RefreshItem(uint32_t slot) { RefreshLogicalRect(GetItemBounds(slot)); }
+
+    // add a loaded item without relayout or refresh
+    uint32_t InsertItem(std::unique_ptr<SvgItem> item, const wxPoint& pos, const wxSize& baseSize, const wxString& label);
+
+    // spatial index and scene extent maintenance: the extent holds the stored
+    // bounds of every visible item
+    void UpdateItemIndex(uint32_t slot);
+    void RebuildIndex();
+    void TrackItemBounds(uint32_t slot);   // O(log n)
+    void UntrackItemBounds(uint32_t slot);
+
+    // items whose stored bounds may reach into 'area', into m_queryItems
+    void QueryItems(const wxRect& area);
+
+    // tiled rendering of items too large to hold as one bitmap
+    static bool IsTiled(const wxSize& size) { return (long long)size.x * size.y > TiledRenderMinPixels; }
+    static wxSize GetPreviewSize(const wxSize& size); // whole-image stand-in for a tiled size
+    bool DrawTiledItem(wxDC& dc, uint32_t slot, const wxRect& rect, const wxRect& area);
+
+    // level-of-detail stand-ins for items a few pixels wide (see SetLodPolicy)
+    bool DrawLodThumbnail(wxDC& dc, uint32_t slot, const wxRect& rect);
+    bool DrawLodProxy(wxDC& dc, SvgItem& item, const wxRect& rect);
+    wxBitmap GetTileStandIn(uint32_t slot, const wxSize& size);
+
+    // area to query the spatial index with while it still holds the bounds of an
+    // earlier zoom (mid-gesture): grown so every item now reaching into 'area' is found
+    wxRect GetIndexQueryArea(const wxRect& area) const;
 
+    // async rendering (col/row select one tile of a tiled render)
+    void RequestRender(uint32_t slot, int w, int h, int col = -1, int row = -1);
+    void CancelPendingRenders();
+    bool HasPendingRenders() const; // queued or running, or finished but not drained yet
+    void DrainCompletedRenders(); // runs on the UI thread
+    // stretch-blit through m_scaleDC, during a paint
+    void DrawBitmapScaled(wxDC& dc, const wxBitmap& bmp, const wxRect& dest);
+    void DrawBitmapScaled(wxDC& dc, const wxBitmap& bmp, const wxRect& dest, const wxRect& src);
+
+    // atlas mode: draw an item from its slot if the atlas holds its current
+    // render; move an exact current render into the atlas
+    bool DrawFromAtlas(wxDC& dc, SvgItem& item, const wxPoint& pos, const wxSize& size);
+    void MoveToAtlas(SvgItem& item, const wxBitmap& bmp);
+    void ReleaseAtlasPage(); // deselect the page from m_atlasDC
+
+    // evict over-budget bitmaps, keeping everything in the visible client area
+    void TrimBitmapCache();
+
+    // repaint what edits changed in one item (document units)
+    void RepaintItemArea(uint32_t slot, const SvgDirtyArea& area);
+
+    // profiler overlay: where it goes (client coordinates), and drawing it at 'pos' (dc coordinates)
+    wxRect GetProfilerOverlayRect() const;
+    void DrawProfilerOverlay(wxDC& dc, const wxPoint& pos);
 
 private:
-    std::vector<std::shared_ptr<SvgItem>> m_items;
+    SvgItemStore m_items;
+
+    // Spatial index over the stored item bounds, kept in sync on add/drag/zoom
+    SvgSpatialGrid m_index;
+    std::vector<uint32_t> m_queryItems; // scratch for paint / hit-test queries
+
+    // Scene extent: right and bottom edges of every visible item, so the
+    // virtual size follows adds, drags and visibility changes in O(log n)
+    std::multiset<int> m_sceneRights;
+    std::multiset<int> m_sceneBottoms;
+    wxSize m_virtualSize; // last size passed to SetVirtualSize()
+
+    // Rendered bitmaps of all items, under one memory budget
+    std::shared_ptr<SvgBitmapCache> m_bitmapCache;
+    std::shared_ptr<SvgDiskCache> m_diskCache;
+
+    // Atlas mode: shared pages of small renders, and the page selected for blitting
+    // during a paint (never while pages are written to)
+    std::unique_ptr<SvgBitmapAtlas> m_atlas;
+    wxMemoryDC m_atlasDC;
+    int m_atlasDCPage;
+
+    // Render buffer pool counters at the end of the last paint, and their change over it
+    SvgRenderBufferPool::Stats m_lastBuffers;
+    SvgRenderBufferPool::Stats m_frameBuffers;
 
     // Dragging state
-    std::shared_ptr<SvgItem> m_dragItem;
+    SvgItemHandle m_dragItem;
     wxPoint m_dragOffset; // offset from item top-left to mouse logical pos while dragging
 
-    // Panning state (right-drag)
+    // Panning state (right-drag): motion only moves the target, scrolled to at
+    // most once per display frame
+    enum { PanFrameMs = 16 };
     bool m_panning;
     wxPoint m_panStartView; // view start (pixels)
-    wxPoint m_panAnchor;    // mouse logical pos at start
+    wxPoint m_panAnchor;    // mouse client pos at start
+    wxPoint m_panTarget;    // view start the drag asks for (pixels)
+    wxTimer m_panTimer;
 
     // Zoom
+    enum { ZoomSettleDelayMs = 150 };
     double m_zoom;
+    bool m_zoomSettling;      // zoom changed recently; draw nearest cached levels, render nothing
+    wxTimer m_zoomSettleTimer;
+    double m_indexZoom;       // zoom the spatial index and scene extent were built at
+    wxSize m_maxBaseSize;     // largest item base size, bounding how far an item grows with the zoom
 
-    // Visual
-    int m_labelHeight;
+    // Tiling: items above this many pixels at the current zoom are drawn as
+    // SvgImageLuna::TileSize tiles, only those in the repainted area
+    enum { TiledRenderMinPixels = 2048 * 2048 };
+    enum { TilePreviewMaxSide = 512 }; // whole-image stand-in (and hit mask) for tiled items
 
-private:
-    SvgItem* m_selectedItem = nullptr;   // currently selected SVG
+    // Update region rectangles, canvas coordinates; past this many the bounding
+    // box is painted instead
+    enum { MaxPaintRects = 8 };
+    std::vector<wxRect> m_paintRects;
+    std::vector<uint32_t> m_paintShown; // items drawn in a frame of several rectangles, for the culled count
+
+    // Rendered labels, and the ones to blit after the icons of the current paint
+    SvgLabelCache m_labelCache;
+    std::vector<std::pair<wxPoint, uint32_t>> m_paintLabels;
+
+    // Level of detail
+    LodPolicy m_lod;
+
+    // Source of scaled blits during a paint: items showing the same render
+    // (thumbnails, mid-zoom levels) keep it selected while they follow each other
+    wxMemoryDC m_scaleDC;
+    wxBitmap m_scaleDCBitmap;
+
+    // Profiling: renders done or queued so far, to tell rendered items from
+    // blitted ones, and the frame the overlay shows
+    unsigned m_paintRenders;
+    bool m_profilerOverlay;
+    SvgProfiler::FrameStats m_overlayFrame;
 
+    // Async rendering
+    struct CompletedRender
+    {
+        SvgItemHandle item;
+        int width;
+        int height;
+        int col;             // tile, or -1 for the whole image
+        int row;
+        unsigned generation;
+        SvgDiskCache::Pixels stored;       // loaded from the disk cache,
+        SvgRenderBuffer pixels;            // else rasterized; converted once, into the native bitmap
+
+        const lunasvg::Bitmap& GetPixels() const { return stored.IsOk() ? stored.GetBitmap() : pixels.GetBitmap(); }
+    };
+
+    bool m_asyncRender;
+    std::unique_ptr<SvgWorkerPool> m_renderPool;        // created on first SetAsyncRender(true)
+    std::mutex m_completedMutex;                          // guards the two members below
+    std::vector<std::unique_ptr<CompletedRender>> m_completed;
+    bool m_drainQueued;
+
+    // Edit transaction: nesting depth and the area changed per item (by slot) so far
+    struct PendingEdit
+    {
+        SvgItemHandle item;
+        SvgDirtyArea area;
+    };
+    int m_editDepth;
+    std::unordered_map<uint32_t, PendingEdit> m_pendingEdits;
+
+    SvgItemHandle m_selectedItem;   // currently selected SVG
+
+};
+
+// Scoped edit transaction: every edit applied through it is repainted once, when
+// it goes out of scope
+class SvgEditTransaction
+{
+public:
+    explicit SvgEditTransaction(SvgCanvas& canvas) : m_canvas(canvas) { m_canvas.BeginEdit(); }
+    ~SvgEditTransaction() { m_canvas.CommitEdit(); }
+
+    SvgEditTransaction(const SvgEditTransaction&) = delete;
+    SvgEditTransaction& operator=(const SvgEditTransaction&) = delete;
+
+    size_t Apply(SvgItemHandle item, const SvgDomEdit& edit) { return m_canvas.ApplyEdit(item, edit); }
+
+private:
+    SvgCanvas& m_canvas;
 };
@@ -0,0 +1,356 @@
+#include "svg_disk_cache.h"
+#include "svg_document_store.h"
+#include "svg_mapped_file.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// On-disk layout of an entry. Bump FormatVersion whenever the layout or the
+// way pixels are produced changes, so older files are rejected rather than shown.
+namespace
+{
+    const char FileMagic[8] = { 'S', 'V', 'G', 'R', 'A', 'S', 'T', '\0' };
+    const uint32_t FormatVersion = 3; // 1: RGB and alpha planes; 2: no renderer, options or header checksum
+    const char FileExtension[] = ".rast";
+    const char TempExtension[] = ".tmp";
+
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t headerSize;
+        uint64_t hash;
+        uint64_t checkHash;
+        int32_t width;        // key: size of the whole image
+        int32_t height;
+        int32_t tile;
+        int32_t imageWidth;   // size of the stored pixels (a tile is smaller)
+        int32_t imageHeight;
+        uint32_t renderer;    // key
+        uint32_t options;
+        uint32_t reserved;
+        uint64_t payloadHash; // SvgDocumentStore::CheckHash() of the rows
+        uint64_t headerHash;  // SvgDocumentStore::CheckHash() of everything above
+    };
+    static_assert(sizeof(FileHeader) == 80, "FileHeader layout must not depend on the compiler");
+
+    uint64_t GetHeaderHash(const FileHeader& header)
+    {
+        return SvgDocumentStore::CheckHash(reinterpret_cast<const char*>(&header), offsetof(FileHeader, headerHash));
+    }
+}
+
+unsigned SvgDiskCache::GetRendererVersion()
+{
+#if defined(LUNASVG_VERSION)
+    return static_cast<unsigned>(lunasvg_version());
+#else
+    return 0;
+#endif
+}
+
+SvgDiskCache::SvgDiskCache(const std::string& directory, size_t budgetBytes)
+    : m_directory(directory)
+    , m_ok(false)
+    , m_budget(budgetBytes)
+    , m_bytes(0)
+    , m_hits(0)
+    , m_misses(0)
+    , m_rejected(0)
+    , m_writes(0)
+    , m_evictions(0)
+{
+    std::error_code ec;
+    fs::create_directories(m_directory, ec);
+    m_ok = fs::is_directory(m_directory, ec);
+    if (m_ok)
+        Scan();
+}
+
+void SvgDiskCache::SetBudget(size_t budgetBytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_budget = budgetBytes;
+    Evict();
+}
+
+size_t SvgDiskCache::GetBudget() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_budget;
+}
+
+std::string SvgDiskCache::GetFileName(const Key& key) const
+{
+    char name[128];
+    snprintf(name, sizeof(name), "%016llx%016llx-%dx%d-%d-r%u-o%u%s", key.hash, key.checkHash,
+             key.width, key.height, key.tile, key.renderer, key.options, FileExtension);
+    return name;
+}
+
+void SvgDiskCache::Scan()
+{
+    struct Found
+    {
+        std::string name;
+        size_t bytes;
+        fs::file_time_type time;
+    };
+    std::vector<Found> found;
+
+    std::error_code ec;
+    for (fs::directory_iterator it(m_directory, ec), end; !ec && it != end; it.increment(ec))
+    {
+        const fs::path& path = it->path();
+        if (path.extension() == TempExtension)
+        {
+            fs::remove(path, ec); // left behind by a write that never finished
+            continue;
+        }
+        if (path.extension() != FileExtension || !it->is_regular_file(ec))
+            continue;
+
+        Found file;
+        file.name = path.filename().string();
+        file.bytes = static_cast<size_t>(it->file_size(ec));
+        file.time = it->last_write_time(ec);
+        if (!ec)
+            found.push_back(file);
+        ec.clear();
+    }
+
+    std::sort(found.begin(), found.end(), [](const Found& a, const Found& b) { return a.time < b.time; });
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const Found& file : found)
+    {
+        m_records[file.name] = m_lru.insert(m_lru.end(), Record{ file.name, file.bytes, false, false });
+        m_bytes += file.bytes;
+    }
+    Evict();
+}
+
+void SvgDiskCache::Pixels::Release()
+{
+    m_bitmap = lunasvg::Bitmap();
+    m_file.Close();
+}
+
+bool SvgDiskCache::Load(const Key& key, Pixels& out)
+{
+    out.Release();
+    if (!m_ok)
+        return false;
+
+    const std::string name = GetFileName(key);
+    bool verify;
+    bool touch;
+    {
+        // Only files seen by Scan() or written since are looked for, so a miss costs no I/O
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto found = m_records.find(name);
+        if (found == m_records.end())
+        {
+            ++m_misses;
+            return false;
+        }
+        verify = !found->second->verified;
+        touch = !found->second->touched;
+    }
+
+    const fs::path path = fs::path(m_directory) / name;
+    SvgMappedFile& file = out.m_file;
+    bool valid = file.Open(path.string()) && file.GetSize() >= sizeof(FileHeader);
+
+    FileHeader header;
+    size_t pixels = 0;
+    if (valid)
+    {
+        memcpy(&header, file.GetData(), sizeof(header));
+        pixels = static_cast<size_t>(header.imageWidth) * static_cast<size_t>(header.imageHeight);
+        valid = memcmp(header.magic, FileMagic, sizeof(FileMagic)) == 0
+             && header.version == FormatVersion
+             && header.headerSize == sizeof(FileHeader)
+             && header.hash == key.hash && header.checkHash == key.checkHash
+             && header.width == key.width && header.height == key.height && header.tile == key.tile
+             && header.renderer == key.renderer && header.options == key.options
+             && header.headerHash == GetHeaderHash(header)
+             && header.imageWidth > 0 && header.imageHeight > 0
+             && file.GetSize() == sizeof(FileHeader) + pixels * 4
+             && (!verify || SvgDocumentStore::CheckHash(file.GetData() + sizeof(FileHeader), pixels * 4) == header.payloadHash);
+    }
+
+    if (!valid)
+    {
+        file.Close();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_records.find(name) != m_records.end())
+        {
+            Remove(name);
+            Forget(name);
+            ++m_rejected;
+        }
+        ++m_misses;
+        return false;
+    }
+
+    // Rows in lunasvg's layout: the mapped pages are the bitmap. lunasvg::Bitmap
+    // takes a mutable pointer, but nothing writes through it (see Pixels).
+    uint8_t* rows = reinterpret_cast<uint8_t*>(const_cast<char*>(file.GetData())) + sizeof(FileHeader);
+    out.m_bitmap = lunasvg::Bitmap(rows, header.imageWidth, header.imageHeight, header.imageWidth * 4);
+
+    // Modification time is the persistent use order; within a session the
+    // in-memory order is enough, so it is written once
+    if (touch)
+    {
+        std::error_code ec;
+        fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_records.find(name);
+    if (found != m_records.end())
+    {
+        found->second->verified = true;
+        found->second->touched = true;
+    }
+    Touch(name);
+    ++m_hits;
+    return true;
+}
+
+bool SvgDiskCache::Save(const Key& key, const lunasvg::Bitmap& pixels)
+{
+    if (!m_ok || !pixels.valid())
+        return false;
+
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FileMagic, sizeof(FileMagic));
+    header.version = FormatVersion;
+    header.headerSize = sizeof(FileHeader);
+    header.hash = key.hash;
+    header.checkHash = key.checkHash;
+    header.width = key.width;
+    header.height = key.height;
+    header.tile = key.tile;
+    header.imageWidth = pixels.width();
+    header.imageHeight = pixels.height();
+    header.renderer = key.renderer;
+    header.options = key.options;
+
+    // Rows are stored packed; renders from SvgRenderBuffer already are
+    const size_t rowBytes = static_cast<size_t>(header.imageWidth) * 4;
+    const size_t payloadSize = rowBytes * static_cast<size_t>(header.imageHeight);
+    const char* payload = reinterpret_cast<const char*>(pixels.data());
+    std::vector<char> packed;
+    if (static_cast<size_t>(pixels.stride()) != rowBytes)
+    {
+        packed.resize(payloadSize);
+        for (int row = 0; row < header.imageHeight; ++row)
+            memcpy(packed.data() + row * rowBytes, pixels.data() + static_cast<size_t>(row) * pixels.stride(), rowBytes);
+        payload = packed.data();
+    }
+    header.payloadHash = SvgDocumentStore::CheckHash(payload, payloadSize);
+    header.headerHash = GetHeaderHash(header);
+
+    // Written under a name unique to this thread, then renamed into place, so a
+    // reader never sees a partial file and concurrent writers do not collide
+    const std::string name = GetFileName(key);
+    const fs::path path = fs::path(m_directory) / name;
+    fs::path temp = path;
+    temp += "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + TempExtension;
+
+    FILE* fp = fopen(temp.string().c_str(), "wb");
+    if (!fp)
+        return false;
+    bool written = fwrite(&header, sizeof(header), 1, fp) == 1
+                && fwrite(payload, 1, payloadSize, fp) == payloadSize;
+    written = fclose(fp) == 0 && written;
+
+    std::error_code ec;
+    if (written)
+        fs::rename(temp, path, ec);
+    if (!written || ec)
+    {
+        fs::remove(temp, ec);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Forget(name);
+    m_records[name] = m_lru.insert(m_lru.end(), Record{ name, sizeof(header) + payloadSize, true, true });
+    m_bytes += sizeof(header) + payloadSize;
+    ++m_writes;
+    Evict();
+    return true;
+}
+
+void SvgDiskCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const Record& record : m_lru)
+        Remove(record.name);
+    m_lru.clear();
+    m_records.clear();
+    m_bytes = 0;
+}
+
+SvgDiskCache::Stats SvgDiskCache::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.rejected = m_rejected;
+    stats.writes = m_writes;
+    stats.evictions = m_evictions;
+    stats.bytes = m_bytes;
+    stats.budget = m_budget;
+    stats.entries = m_records.size();
+    return stats;
+}
+
+void SvgDiskCache::Touch(const std::string& name)
+{
+    auto found = m_records.find(name);
+    if (found != m_records.end())
+        m_lru.splice(m_lru.end(), m_lru, found->second);
+}
+
+void SvgDiskCache::Forget(const std::string& name)
+{
+    auto found = m_records.find(name);
+    if (found == m_records.end())
+        return;
+
+    m_bytes -= found->second->bytes;
+    m_lru.erase(found->second);
+    m_records.erase(found);
+}
+
+void SvgDiskCache::Evict()
+{
+    while (m_budget != 0 && m_bytes > m_budget && !m_lru.empty())
+    {
+        const std::string name = m_lru.front().name;
+        Remove(name);
+        Forget(name);
+        ++m_evictions;
+    }
+}
+
+void SvgDiskCache::Remove(const std::string& name) const
+{
+    std::error_code ec;
+    fs::remove(fs::path(m_directory) / name, ec);
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "lunasvg.h"
+#include "svg_mapped_file.h"
+
+// Rendered images kept on disk across launches, so a warm start loads its
+// renders instead of rasterizing every document again. Entries are keyed by
+// the document's content hashes, the pixel size, the tile index, the lunasvg
+// version and the render options; edited documents have no stable key and
+// never use it.
+//
+// One file per entry: a fixed header followed by the premultiplied BGRA rows
+// exactly as lunasvg renders them, so a load maps the file and hands the
+// mapped pages over as a lunasvg bitmap, to be written into a native bitmap
+// like a fresh render (no copy, no decoding). Files are written to a temporary name and
+// renamed into place. A file that is truncated, has the wrong key or fails its
+// checksums is deleted and reported as a miss. Every load checks the header's
+// checksum; the pixels' checksum is checked on the first load of a session only.
+//
+// The directory is kept under a byte budget, evicting the least recently used
+// files (by modification time, so the order survives restarts; a file's time is
+// updated on its first load of a session, not on every one).
+// Thread-safe: render workers load and save directly.
+class SvgDiskCache
+{
+public:
+    enum { DefaultBudgetMB = 512 };
+
+    struct Key
+    {
+        unsigned long long hash;      // SvgSharedDocument::hash
+        unsigned long long checkHash; // SvgSharedDocument::checkHash
+        int width;                    // size of the whole image
+        int height;
+        int tile;                     // SvgBitmapCache::WholeImage, or row-major tile index
+        unsigned renderer;            // GetRendererVersion(): a lunasvg upgrade invalidates every render
+        unsigned options;             // render settings that change the pixels, caller-defined
+    };
+
+    struct Stats
+    {
+        unsigned long long hits;
+        unsigned long long misses;
+        unsigned long long rejected;  // corrupt or mismatched files deleted
+        unsigned long long writes;
+        unsigned long long evictions;
+        size_t bytes;
+        size_t budget;
+        size_t entries;
+    };
+
+    // Creates the directory if needed; budgetBytes == 0 means unlimited
+    explicit SvgDiskCache(const std::string& directory, size_t budgetBytes = size_t(DefaultBudgetMB) << 20);
+
+    SvgDiskCache(const SvgDiskCache&) = delete;
+    SvgDiskCache& operator=(const SvgDiskCache&) = delete;
+
+    // Version of the lunasvg library in use (as loaded, not as compiled against
+    // where lunasvg can tell); 0 if unknown
+    static unsigned GetRendererVersion();
+
+    bool IsOk() const { return m_ok; }
+    const std::string& GetDirectory() const { return m_directory; }
+
+    void SetBudget(size_t budgetBytes);
+    size_t GetBudget() const;
+
+    // A loaded entry: its file stays mapped while this is held. The bitmap wraps
+    // the read-only mapping: read from it, never render into it.
+    class Pixels
+    {
+    public:
+        bool IsOk() const { return m_file.IsOpen(); }
+        const lunasvg::Bitmap& GetBitmap() const { return m_bitmap; }
+        void Release();
+
+    private:
+        friend class SvgDiskCache;
+        SvgMappedFile m_file;
+        lunasvg::Bitmap m_bitmap;
+    };
+
+    // Pixels stored under key; false if there is no valid entry
+    bool Load(const Key& key, Pixels& out);
+
+    // Write a render under key, evicting old entries past the budget
+    bool Save(const Key& key, const lunasvg::Bitmap& pixels);
+
+    void Clear(); // delete every entry
+    Stats GetStats() const;
+
+private:
+    struct Record
+    {
+        std::string name;
+        size_t bytes;
+        bool verified; // pixels' checksum checked, or written, this session
+        bool touched;  // modification time updated this session
+    };
+    typedef std::list<Record> RecordList; // LRU order: front is least recently used
+
+    std::string GetFileName(const Key& key) const;
+    void Scan();
+    void Touch(const std::string& name);        // caller holds m_mutex
+    void Forget(const std::string& name);       // caller holds m_mutex
+    void Evict();                               // caller holds m_mutex
+    void Remove(const std::string& name) const; // delete the file
+
+private:
+    std::string m_directory;
+    bool m_ok;
+
+    mutable std::mutex m_mutex;
+    RecordList m_lru;
+    std::unordered_map<std::string, RecordList::iterator> m_records;
+    size_t m_budget;
+    size_t m_bytes;
+    unsigned long long m_hits;
+    unsigned long long m_misses;
+    unsigned long long m_rejected;
+    unsigned long long m_writes;
+    unsigned long long m_evictions;
+};
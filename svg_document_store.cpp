@@ -0,0 +1,334 @@
+#include "svg_document_store.h"
+#include "svg_mapped_file.h"
+#include "svg_profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+static bool SameSource(const SvgSharedDocument& doc, const char* data, size_t size, unsigned long long checkHash)
+{
+    if (doc.size != size)
+        return false;
+    if (!doc.text.empty())
+        return memcmp(doc.text.data(), data, size) == 0;
+    return doc.checkHash == checkHash;
+}
+
+static std::shared_ptr<SvgSharedDocument> FindInBucket(std::vector<std::weak_ptr<SvgSharedDocument>>& bucket,
+                                                       const char* data, size_t size, unsigned long long checkHash)
+{
+    for (const auto& weak : bucket)
+    {
+        auto doc = weak.lock();
+        if (doc && SameSource(*doc, data, size, checkHash))
+            return doc;
+    }
+    return nullptr;
+}
+
+SvgDocumentStore& SvgDocumentStore::Get()
+{
+    static SvgDocumentStore store;
+    return store;
+}
+
+std::shared_ptr<SvgSharedDocument> SvgDocumentStore::Intern(const char* data, size_t size, const std::string& path)
+{
+    const unsigned long long hash = Hash(data, size);
+    const unsigned long long checkHash = CheckHash(data, size);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto found = m_documents.find(hash);
+        if (found != m_documents.end())
+        {
+            if (auto doc = FindInBucket(found->second, data, size, checkHash))
+                return doc;
+        }
+    }
+
+    // Parse without holding the lock so other loads proceed meanwhile.
+    // A source that cannot be re-read is always kept.
+    const bool keepText = m_policy == KeepSource || path.empty();
+    auto doc = Parse(data, size, path, keepText, hash, checkHash);
+    if (!doc)
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& bucket = m_documents[hash];
+    if (auto existing = FindInBucket(bucket, data, size, checkHash))
+        return existing; // another thread parsed the same source first
+
+    doc->interned = true;
+    bucket.push_back(doc);
+
+    if (++m_insertsSinceSweep > m_documents.size())
+        SweepExpired();
+    return doc;
+}
+
+std::shared_ptr<SvgSharedDocument> SvgDocumentStore::CreatePrivate(const std::string& text)
+{
+    return Parse(text.data(), text.size(), std::string(), true,
+                 Hash(text.data(), text.size()), CheckHash(text.data(), text.size()));
+}
+
+std::shared_ptr<SvgSharedDocument> SvgDocumentStore::CreateCopy(const SvgSharedDocument& doc) const
+{
+    const bool keepText = m_policy == KeepSource || doc.path.empty();
+    std::shared_ptr<SvgSharedDocument> copy;
+    if (!doc.text.empty())
+        copy = Parse(doc.text.data(), doc.text.size(), doc.path, keepText, doc.hash, doc.checkHash);
+    else
+    {
+        SvgMappedFile file;
+        if (!MapSource(doc, file))
+            return nullptr;
+        copy = Parse(file.GetData(), file.GetSize(), doc.path, keepText, doc.hash, doc.checkHash);
+    }
+    if (!copy)
+        return nullptr;
+
+    for (const SvgDomEdit& edit : doc.edits)
+        ApplyEdit(*copy->document, edit);
+    copy->edits = doc.edits;
+    copy->edited = doc.edited;
+    return copy;
+}
+
+bool SvgDocumentStore::ReadSource(const SvgSharedDocument& doc, std::string& text)
+{
+    if (!doc.text.empty())
+    {
+        text = doc.text;
+        return true;
+    }
+
+    SvgMappedFile file;
+    if (!MapSource(doc, file))
+        return false;
+    text.assign(file.GetData(), file.GetSize());
+    return true;
+}
+
+bool SvgDocumentStore::MapSource(const SvgSharedDocument& doc, SvgMappedFile& file)
+{
+    if (doc.path.empty() || !file.Open(doc.path))
+        return false;
+
+    // The file may have changed since it was loaded
+    return file.GetSize() == doc.size && Hash(file.GetData(), file.GetSize()) == doc.hash
+        && CheckHash(file.GetData(), file.GetSize()) == doc.checkHash;
+}
+
+void SvgDirtyArea::Add(float x, float y, float width, float height)
+{
+    if (width <= 0 || height <= 0)
+        return;
+
+    if (empty)
+    {
+        left = x;
+        top = y;
+        right = x + width;
+        bottom = y + height;
+        empty = false;
+        return;
+    }
+    left = std::min(left, x);
+    top = std::min(top, y);
+    right = std::max(right, x + width);
+    bottom = std::max(bottom, y + height);
+}
+
+// What an element paints: its geometry grown by its stroke. Filters can paint
+// anywhere, so under one the whole drawing counts.
+static void AddElementArea(const lunasvg::Element& element, SvgDirtyArea& area)
+{
+    for (lunasvg::Element e = element; !e.isNull(); e = e.parentElement())
+    {
+        if (e.hasAttribute("filter"))
+        {
+            area.AddWhole();
+            return;
+        }
+    }
+
+    // Half the stroke width outside the geometry, doubled for miter joins; one
+    // unit when there is no stroke-width attribute (styles set from CSS are not seen)
+    float margin = 1.0f;
+    if (element.hasAttribute("stroke-width"))
+        margin = std::max(margin, std::strtof(element.getAttribute("stroke-width").c_str(), nullptr));
+
+    const lunasvg::Box box = element.getGlobalBoundingBox();
+    area.Add(box.x - margin, box.y - margin, box.w + 2 * margin, box.h + 2 * margin);
+}
+
+size_t SvgDocumentStore::ApplyEdit(lunasvg::Document& document, const SvgDomEdit& edit, SvgDirtyArea* area)
+{
+    if (edit.kind == SvgDomEdit::ApplyStyleSheet)
+    {
+        if (!document.applyStyleSheet(edit.value))
+            return 0;
+        if (area)
+            area->AddWhole();
+        return 1;
+    }
+
+    auto elements = document.querySelectorAll(edit.selector);
+    if (edit.kind == SvgDomEdit::SetText)
+    {
+        if (edit.index >= elements.size())
+            return 0;
+        lunasvg::ElementList target(1, elements[edit.index]);
+        elements.swap(target);
+    }
+
+    // Before: the area the old content covered
+    if (area)
+    {
+        for (const auto& element : elements)
+            AddElementArea(element, *area);
+    }
+
+    size_t changed = 0;
+    for (auto& element : elements)
+    {
+        if (edit.kind == SvgDomEdit::SetAttribute)
+        {
+            element.setAttribute(edit.name, edit.value);
+            ++changed;
+            continue;
+        }
+        for (auto& child : element.children())
+        {
+            if (child.isTextNode())
+            {
+                child.toTextNode().setData(edit.value);
+                ++changed;
+            }
+        }
+    }
+
+    // After: the area the new content covers
+    if (area && changed)
+    {
+        document.updateLayout();
+        for (const auto& element : elements)
+            AddElementArea(element, *area);
+    }
+    return changed;
+}
+
+std::shared_ptr<SvgSharedDocument> SvgDocumentStore::Parse(const char* data, size_t size, const std::string& path, bool keepText,
+                                                           unsigned long long hash, unsigned long long checkHash)
+{
+    if (size == 0)
+        return nullptr;
+
+    SvgProfileScope profile("parse");
+    auto document = lunasvg::Document::loadFromData(data, size);
+    if (!document)
+        return nullptr;
+
+    auto doc = std::make_shared<SvgSharedDocument>();
+    if (keepText)
+        doc->text.assign(data, size);
+    doc->path = path;
+    doc->document = std::move(document);
+    doc->mutex = std::make_shared<std::mutex>();
+    doc->size = size;
+    doc->hash = hash;
+    doc->checkHash = checkHash;
+    doc->generation = NextGeneration();
+    doc->interned = false;
+    doc->edited = false;
+    doc->averageGeneration = 0;
+    doc->averageColor = 0;
+    return doc;
+}
+
+void SvgDocumentStore::Forget(SvgSharedDocument& doc)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!doc.interned)
+        return;
+    doc.interned = false;
+
+    auto found = m_documents.find(doc.hash);
+    if (found == m_documents.end())
+        return;
+
+    auto& bucket = found->second;
+    bucket.erase(std::remove_if(bucket.begin(), bucket.end(),
+        [&doc](const std::weak_ptr<SvgSharedDocument>& weak)
+        {
+            auto live = weak.lock();
+            return !live || live.get() == &doc;
+        }), bucket.end());
+    if (bucket.empty())
+        m_documents.erase(found);
+}
+
+size_t SvgDocumentStore::GetCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t count = 0;
+    for (const auto& it : m_documents)
+        for (const auto& weak : it.second)
+            count += weak.expired() ? 0 : 1;
+    return count;
+}
+
+unsigned long long SvgDocumentStore::Hash(const char* data, size_t size)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+unsigned long long SvgDocumentStore::CheckHash(const char* data, size_t size)
+{
+    unsigned long long hash = size * 0x9E3779B97F4A7C15ULL;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        unsigned long long word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 0xFF51AFD7ED558CCDULL;
+        hash ^= hash >> 32;
+    }
+    for (; i < size; ++i)
+    {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 0xC4CEB9FE1A85EC53ULL;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+unsigned SvgDocumentStore::NextGeneration()
+{
+    static std::atomic<unsigned> counter(0);
+    return ++counter;
+}
+
+void SvgDocumentStore::SweepExpired()
+{
+    // Documents whose last image went away leave expired entries behind
+    for (auto it = m_documents.begin(); it != m_documents.end(); )
+    {
+        auto& bucket = it->second;
+        bucket.erase(std::remove_if(bucket.begin(), bucket.end(),
+            [](const std::weak_ptr<SvgSharedDocument>& weak) { return weak.expired(); }), bucket.end());
+        if (bucket.empty())
+            it = m_documents.erase(it);
+        else
+            ++it;
+    }
+    m_insertsSinceSweep = 0;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "lunasvg.h"
+
+class SvgMappedFile;
+
+// One DOM edit, recorded so the edited document can be rebuilt from its source
+// (copy-on-write, scene snapshots). Edits made directly through the lunasvg API
+// are not recorded.
+struct SvgDomEdit
+{
+    enum Kind
+    {
+        SetAttribute,   // name = value on every element matching selector
+        SetText,        // text nodes of the index-th element matching selector = value
+        ApplyStyleSheet // value is CSS applied to the whole document
+    };
+
+    Kind kind;
+    std::string selector;
+    unsigned index;
+    std::string name;
+    std::string value;
+};
+
+// Part of a document's drawing changed by edits, in document units (those of
+// Document::width()/height()), or the whole of it
+struct SvgDirtyArea
+{
+    bool empty = true;
+    bool whole = false;
+    float left = 0;
+    float top = 0;
+    float right = 0;
+    float bottom = 0;
+
+    void Add(float x, float y, float width, float height);
+    void AddWhole() { whole = true; empty = false; }
+};
+
+// One parsed SVG source, shared by every SvgImageLuna loaded from identical
+// text (and, through the bitmap cache key, their renders too). Never mutated
+// while interned: an image detaches a private copy before it is edited.
+struct SvgSharedDocument
+{
+    std::string text;                            // source, empty if released (see SourcePolicy)
+    std::string path;                            // file it was loaded from, empty for strings
+    std::shared_ptr<lunasvg::Document> document;
+    std::shared_ptr<std::mutex> mutex;           // guards document against background renders
+    size_t size;                                 // of the source
+    unsigned long long hash;                     // SvgDocumentStore::Hash() of the source
+    unsigned long long checkHash;                // SvgDocumentStore::CheckHash(), to match without the text
+    unsigned generation;                         // from SvgDocumentStore::NextGeneration(), renewed on every edit
+    bool interned;                               // listed in SvgDocumentStore
+    bool edited;                                 // handed out for editing: the hashes no longer describe it
+    std::vector<SvgDomEdit> edits;               // recorded edits since parsing, in order
+
+    // Level of detail (SvgImageLuna::GetAverageColor), derived on the UI thread
+    unsigned averageGeneration;                  // generation averageColor was computed for, 0 if never
+    uint32_t averageColor;                       // premultiplied ARGB
+};
+
+// Process-wide table of parsed documents keyed by a content hash. Holds them
+// weakly: a document goes away with the last image using it. Thread-safe, so
+// files can be loaded from worker threads.
+class SvgDocumentStore
+{
+public:
+    // What happens to the source text once parsed. It is only needed to parse
+    // the document again, which copy-on-write does before an edit.
+    enum SourcePolicy
+    {
+        KeepSource,             // keep every source in memory next to its DOM
+        ReleaseReloadableSource // drop sources that can be re-read from their file
+    };
+
+    static SvgDocumentStore& Get();
+
+    void SetSourcePolicy(SourcePolicy policy) { m_policy = policy; }
+    SourcePolicy GetSourcePolicy() const { return m_policy; }
+
+    // Shared document for this source, parsing it only if no live document has
+    // the same content. 'path' names the file the data was read or mapped from,
+    // if any. nullptr if the source does not parse.
+    std::shared_ptr<SvgSharedDocument> Intern(const char* data, size_t size, const std::string& path = std::string());
+    std::shared_ptr<SvgSharedDocument> Intern(const std::string& text) { return Intern(text.data(), text.size()); }
+
+    // Unshared document for this source (parsed again even if interned), keeping its text
+    static std::shared_ptr<SvgSharedDocument> CreatePrivate(const std::string& text);
+
+    // Unshared, freshly parsed copy of 'doc' for copy-on-write. Uses the kept
+    // text, else re-reads the file; nullptr if that file no longer has the
+    // content 'doc' was parsed from.
+    std::shared_ptr<SvgSharedDocument> CreateCopy(const SvgSharedDocument& doc) const;
+
+    // Source text of 'doc': the kept text, else re-read from its file. False if
+    // that file no longer has the content 'doc' was parsed from.
+    static bool ReadSource(const SvgSharedDocument& doc, std::string& text);
+
+    // Apply one edit; returns the number of nodes it changed (caller holds the
+    // document mutex if the document may be rendering). With 'area', what the
+    // changed elements covered before and after the edit is added to it.
+    static size_t ApplyEdit(lunasvg::Document& document, const SvgDomEdit& edit, SvgDirtyArea* area = nullptr);
+
+    // Stop handing out 'doc' to new loads, e.g. because it is about to be edited
+    void Forget(SvgSharedDocument& doc);
+
+    size_t GetCount() const; // live interned documents
+
+    // 64-bit FNV-1a
+    static unsigned long long Hash(const char* data, size_t size);
+
+    // Independent 64-bit word hash; with Hash() and the size it identifies a
+    // source whose text was released
+    static unsigned long long CheckHash(const char* data, size_t size);
+
+    // Generation numbers are unique across documents, so a render started for a
+    // document an image has since dropped can never match its current one.
+    static unsigned NextGeneration();
+
+private:
+    SvgDocumentStore() : m_insertsSinceSweep(0), m_policy(KeepSource) {}
+
+    static std::shared_ptr<SvgSharedDocument> Parse(const char* data, size_t size, const std::string& path, bool keepText,
+                                                     unsigned long long hash, unsigned long long checkHash);
+    static bool MapSource(const SvgSharedDocument& doc, SvgMappedFile& file); // and verify it
+    void SweepExpired(); // caller holds m_mutex
+
+private:
+    mutable std::mutex m_mutex;
+    std::unordered_map<unsigned long long, std::vector<std::weak_ptr<SvgSharedDocument>>> m_documents;
+    size_t m_insertsSinceSweep;
+    std::atomic<SourcePolicy> m_policy;
+};
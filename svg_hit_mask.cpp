@@ -0,0 +1,61 @@
+#include "svg_hit_mask.h"
+
+#include <algorithm>
+
+SvgHitMask::SvgHitMask()
+    : m_width(0)
+    , m_height(0)
+    , m_wordsPerRow(0)
+{
+}
+
+void SvgHitMask::Reset(int width, int height)
+{
+    if (width <= 0 || height <= 0)
+    {
+        width = height = 0;
+    }
+
+    m_width = width;
+    m_height = height;
+    m_wordsPerRow = (width + 31) / 32;
+    m_bits.assign(static_cast<size_t>(m_wordsPerRow) * height, 0u);
+}
+
+void SvgHitMask::BuildFromBgra(const unsigned char* src, int stride, int width, int height)
+{
+    Reset(width, height);
+
+    for (int y = 0; y < m_height; ++y)
+    {
+        const unsigned char* row = src + y * stride;
+        uint32_t* out = GetRowBits(y);
+        for (int x = 0; x < m_width; ++x)
+        {
+            if (row[x * 4 + 3] > AlphaThreshold)
+                out[x >> 5] |= 1u << (x & 31);
+        }
+    }
+}
+
+void SvgHitMask::UpdateFromBgra(const unsigned char* src, int stride, int x, int y, int width, int height)
+{
+    const int x0 = std::max(x, 0);
+    const int y0 = std::max(y, 0);
+    const int x1 = std::min(x + width, m_width);
+    const int y1 = std::min(y + height, m_height);
+
+    for (int py = y0; py < y1; ++py)
+    {
+        const unsigned char* row = src + (py - y) * stride;
+        uint32_t* out = GetRowBits(py);
+        for (int px = x0; px < x1; ++px)
+        {
+            const uint32_t bit = 1u << (px & 31);
+            if (row[(px - x) * 4 + 3] > AlphaThreshold)
+                out[px >> 5] |= bit;
+            else
+                out[px >> 5] &= ~bit;
+        }
+    }
+}
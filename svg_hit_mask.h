@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compact 1-bit alpha mask of a rendered bitmap: a bit is set where the pixel's
+// alpha is above the hit threshold. Lets picking test one bit instead of
+// converting the whole bitmap back to a wxImage.
+class SvgHitMask
+{
+public:
+    enum { AlphaThreshold = 10 }; // same threshold the canvas always used
+
+    SvgHitMask();
+
+    // Clear to an all-transparent mask of the given size.
+    void Reset(int width, int height);
+    void Clear() { Reset(0, 0); }
+
+    // Build from premultiplied BGRA pixels (lunasvg layout).
+    void BuildFromBgra(const unsigned char* src, int stride, int width, int height);
+
+    // Rebuild the bits of the rectangle at (x, y) from BGRA pixels covering it,
+    // leaving the rest of the mask alone (clipped to the mask).
+    void UpdateFromBgra(const unsigned char* src, int stride, int x, int y, int width, int height);
+
+    // Raw bits of row 'y' (bit x & 31 of word x >> 5); used by converters that
+    // build the mask while they walk the pixels anyway.
+    uint32_t* GetRowBits(int y) { return &m_bits[static_cast<size_t>(y) * m_wordsPerRow]; }
+
+    bool Test(int x, int y) const
+    {
+        if (x < 0 || y < 0 || x >= m_width || y >= m_height)
+            return false;
+        return (m_bits[y * m_wordsPerRow + (x >> 5)] >> (x & 31)) & 1u;
+    }
+
+    int GetWidth() const { return m_width; }
+    int GetHeight() const { return m_height; }
+    bool IsEmpty() const { return m_width == 0 || m_height == 0; }
+
+private:
+    int m_width;
+    int m_height;
+    int m_wordsPerRow;
+    std::vector<uint32_t> m_bits;
+};
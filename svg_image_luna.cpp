@@ -1,6 +1,14 @@
 #include "svg_image_luna.h"
+#include "svg_mapped_file.h"
+#include "svg_pixel_convert.h"
+#include "svg_profiler.h"
 
+#include <wx/rawbmp.h>
+
+#include <algorithm>
+#include <cmath>
 #include <fstream>
+#include <utility>
 #include <vector>
 
 #ifdef __WXMSW__
@@ -10,69 +18,530 @@
   #include <windows.h>
 #endif
 
+// BGRA (premultiplied) -> RGB + alpha planes of a wxImage, plus the hit mask.
+// The planes are leased from the render buffer pool: 'img' uses them as static
+// data, valid while 'planes' is held.
+static void ConvertBitmapToImage(const lunasvg::Bitmap& lbmp, wxImage& img, SvgHitMask& mask,
+                                 SvgRenderBufferPool::Lease& planes);
+
+// lunasvg bitmap -> wxBitmap (native DIB upload on MSW, raw pixel access elsewhere),
+// plus the hit mask
+static wxBitmap ConvertToBitmap(const lunasvg::Bitmap& lbmp, SvgHitMask& mask);
+
+// Overwrite the pixels of 'bmp' at (x, y) with a lunasvg bitmap, alpha included.
+// 'mask', if given, must be Reset() to the lunasvg bitmap's size and is filled in the same pass.
+static bool WriteToBitmap(const lunasvg::Bitmap& lbmp, wxBitmap& bmp, int x, int y, SvgHitMask* mask = nullptr);
+
 SvgImageLuna::SvgImageLuna()
-    : m_cachedWidth(0)
-    , m_cachedHeight(0)
-    , m_cachedScale(0.0)
-    , m_dirty(true)
+    : m_dirty(true)
+{
+}
+
+SvgImageLuna::~SvgImageLuna()
 {
+    ReleaseCachedLevels();
+}
+
+void SvgImageLuna::SetBitmapCache(const std::shared_ptr<SvgBitmapCache>& cache)
+{
+    if (cache == m_cache)
+        return;
+
+    ReleaseCachedLevels();
+    m_cache = cache;
+}
+
+void SvgImageLuna::ReleaseCachedLevels()
+{
+    // Other images showing the same shared document keep using its entries
+    if (m_cache && (!m_shared || m_shared.use_count() == 1))
+        m_cache->RemoveOwner(GetCacheKey());
+}
+
+SvgBitmapCache& SvgImageLuna::GetCache() const
+{
+    if (!m_cache)
+        m_cache = std::make_shared<SvgBitmapCache>(0);
+    return *m_cache;
 }
 
 bool SvgImageLuna::LoadFromFile(const std::string& filePath)
 {
+    // Parse straight from the page cache; the store copies the text only if
+    // its SourcePolicy keeps it
+    SvgMappedFile mapped;
+    if (mapped.Open(filePath))
+    {
+        SetDocument(SvgDocumentStore::Get().Intern(mapped.GetData(), mapped.GetSize(), filePath));
+        return (bool)m_shared;
+    }
+
     std::ifstream ifs(filePath, std::ios::binary);
     if (!ifs) return false;
 
-    m_svgText.assign(
-        std::istreambuf_iterator<char>(ifs),
-        std::istreambuf_iterator<char>()
-    );
-    return ParseDocument();
+    std::string svgText;
+    ifs.seekg(0, std::ios::end);
+    const std::streamoff size = ifs.tellg();
+    ifs.seekg(0, std::ios::beg);
+    if (size > 0)
+    {
+        svgText.resize(static_cast<size_t>(size));
+        if (!ifs.read(&svgText[0], size))
+            return false;
+    }
+    else
+    {
+        // Size unknown (a pipe or similar)
+        ifs.clear();
+        svgText.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    }
+    return LoadFromString(svgText);
 }
 
 bool SvgImageLuna::LoadFromString(const std::string& svgText)
 {
-    m_svgText = svgText;
-    return ParseDocument();
+    SetDocument(SvgDocumentStore::Get().Intern(svgText));
+    return (bool)m_shared;
+}
+
+void SvgImageLuna::SetDocument(const std::shared_ptr<SvgSharedDocument>& shared)
+{
+    ReleaseCachedLevels();
+    m_shared = shared;
+    m_deferred.reset();
+    m_dirty = true;
 }
 
-bool SvgImageLuna::ParseDocument()
+void SvgImageLuna::SetDeferredSource(const std::shared_ptr<const SvgDeferredSource>& source)
 {
-    m_document.reset();
-    if (m_svgText.empty())
+    SetDocument(nullptr);
+    m_deferred = source;
+}
+
+bool SvgImageLuna::Materialize() const
+{
+    if (m_shared || !m_deferred)
+        return m_shared != nullptr;
+
+    std::shared_ptr<const SvgDeferredSource> source;
+    source.swap(m_deferred);
+    if (!source->text)
         return false;
 
-    m_document = lunasvg::Document::loadFromData(m_svgText);
+    const std::string& text = *source->text;
+    if (source->edits.empty())
+    {
+        m_shared = SvgDocumentStore::Get().Intern(text);
+        return m_shared != nullptr;
+    }
+
+    // An edited document is never shared: rebuild a private copy. Nothing can be
+    // rendering it yet, so no lock is needed.
+    auto doc = SvgDocumentStore::CreatePrivate(text);
+    if (!doc)
+        return false;
+    for (const SvgDomEdit& edit : source->edits)
+        SvgDocumentStore::ApplyEdit(*doc->document, edit);
+    doc->edits = source->edits;
+    doc->edited = true;
+    m_shared = doc;
+    return true;
+}
+
+std::shared_ptr<lunasvg::Document> SvgImageLuna::GetDocumentForEdit()
+{
+    if (!Materialize())
+        return nullptr;
+
+    if (m_shared->interned && m_shared.use_count() == 1)
+    {
+        // Sole user: edit in place, but stop handing it out to new loads
+        SvgDocumentStore::Get().Forget(*m_shared);
+    }
+    else if (m_shared->interned || m_shared.use_count() > 1)
+    {
+        // Copy-on-write: re-parse the source into a document of our own.
+        // The shared renders stay with the images still using them; this one
+        // starts from copies of them, so area edits have renders to patch.
+        auto copy = SvgDocumentStore::Get().CreateCopy(*m_shared);
+        if (!copy)
+            return nullptr;
+        if (GetCache().CopyOwner(m_shared.get(), m_shared->generation, copy.get(), copy->generation) == 0)
+            m_dirty = true;
+        m_shared = copy;
+    }
+    m_shared->edited = true;
+    return m_shared->document;
+}
+
+size_t SvgImageLuna::ApplyEdit(const SvgDomEdit& edit, SvgDirtyArea* area)
+{
+    auto document = GetDocumentForEdit();
+    if (!document)
+        return 0;
+
+    size_t changed;
+    {
+        auto lock = LockDocument();
+        changed = SvgDocumentStore::ApplyEdit(*document, edit, area);
+        if (changed)
+            m_shared->edits.push_back(edit);
+    }
+    if (changed && !area)
+        MarkDirty();
+    return changed;
+}
+
+bool SvgImageLuna::RepaintArea(const SvgDirtyArea& area)
+{
+    if (!m_shared || area.empty)
+        return true;
+
+    if (area.whole)
+    {
+        MarkDirty();
+        return false;
+    }
+
+    std::vector<SvgBitmapCache::Entry*> entries;
+    GetCache().GetEntries(GetCacheKey(), GetGeneration(), entries);
+    if (entries.empty())
+    {
+        // Nothing to patch: whatever was drawn of this image must be rendered again whole
+        MarkDirty();
+        return false;
+    }
+
+    // A new generation, so renders still in flight for the old content are dropped
+    // when they arrive; patched entries move to it, the others go stale
+    const unsigned generation = SvgDocumentStore::NextGeneration();
+    m_shared->generation = generation;
+
+    bool patchedAll = true;
+    {
+        std::lock_guard<std::mutex> lock(*m_shared->mutex);
+        for (SvgBitmapCache::Entry* entry : entries)
+        {
+            if (PatchEntry(*m_shared->document, *entry, area))
+                entry->generation = generation;
+            else
+                patchedAll = false;
+        }
+    }
+    if (!patchedAll)
+        m_dirty = true;
+    return patchedAll;
+}
+
+bool SvgImageLuna::PatchEntry(const lunasvg::Document& document, SvgBitmapCache::Entry& entry, const SvgDirtyArea& area)
+{
+    if (document.width() <= 0 || document.height() <= 0 || !entry.bitmap.IsOk())
+        return false; // released bitmaps are rendered again whole
+
+    wxRect bounds(0, 0, entry.width, entry.height);
+    if (entry.tile != SvgBitmapCache::WholeImage)
+    {
+        const int columns = (entry.width + TileSize - 1) / TileSize;
+        bounds = GetTileRect(entry.width, entry.height, entry.tile % columns, entry.tile / columns);
+    }
+
+    // The area in this render's pixels, grown by a pixel for antialiasing
+    const float sx = entry.width / document.width();
+    const float sy = entry.height / document.height();
+    const int left = static_cast<int>(std::floor(area.left * sx)) - 1;
+    const int top = static_cast<int>(std::floor(area.top * sy)) - 1;
+    const int right = static_cast<int>(std::ceil(area.right * sx)) + 1;
+    const int bottom = static_cast<int>(std::ceil(area.bottom * sy)) + 1;
+    const wxRect rect = wxRect(left, top, right - left, bottom - top).Intersect(bounds);
+    if (rect.IsEmpty())
+        return true;
+
+    // Same mapping as the full render, shifted to the patch corner
+    SvgRenderBuffer buffer(rect.width, rect.height);
+    if (!buffer.IsOk())
+        return false;
+    lunasvg::Bitmap& lbmp = buffer.GetBitmap();
+    document.render(lbmp, lunasvg::Matrix(sx, 0, 0, sy, static_cast<float>(-rect.x), static_cast<float>(-rect.y)));
+
+    const int x = rect.x - bounds.x;
+    const int y = rect.y - bounds.y;
+    if (!WriteToBitmap(lbmp, entry.bitmap, x, y))
+        return false;
+    entry.mask.UpdateFromBgra(lbmp.data(), lbmp.stride(), x, y, rect.width, rect.height);
+    return true;
+}
+
+void SvgImageLuna::MarkDirty()
+{
     m_dirty = true;
-    return (bool)m_document;
+    if (m_shared)
+        m_shared->generation = SvgDocumentStore::NextGeneration();
 }
 
 wxBitmap SvgImageLuna::Render(int width, int height, double scale)
 {
-    if (!m_document)
+    SvgProfileScope profile("render", SvgProfiler::NoTiming, width, height);
+    if (!Materialize())
         return wxBitmap();
 
     // Cache hit → return directly
-    if (!m_dirty &&
-        m_cachedBitmap.IsOk() &&
-        m_cachedWidth == width &&
-        m_cachedHeight == height &&
-        m_cachedScale == scale)
+    if (const SvgBitmapCache::Entry* level = GetCache().Find(GetCacheKey(), width, height,
+                                                             SvgBitmapCache::WholeImage, GetGeneration()))
+        return level->bitmap;
+
+    return RenderLevel(width, height, -1, -1);
+}
+
+wxRect SvgImageLuna::GetTileRect(int width, int height, int col, int row)
+{
+    wxRect rect(col * TileSize, row * TileSize, TileSize, TileSize);
+    return rect.Intersect(wxRect(0, 0, width, height));
+}
+
+wxBitmap SvgImageLuna::GetCachedTile(int width, int height, int col, int row) const
+{
+    const SvgBitmapCache::Entry* tile = GetCache().Find(GetCacheKey(), width, height,
+                                                        GetTileIndex(width, col, row), GetGeneration(), true);
+    return tile ? tile->bitmap : wxBitmap();
+}
+
+wxBitmap SvgImageLuna::RenderTile(int width, int height, int col, int row)
+{
+    SvgProfileScope profile("render_tile", SvgProfiler::NoTiming, width, height);
+    if (!Materialize())
+        return wxBitmap();
+
+    const int index = GetTileIndex(width, col, row);
+    if (const SvgBitmapCache::Entry* tile = GetCache().Find(GetCacheKey(), width, height, index, GetGeneration()))
+        return tile->bitmap;
+
+    return RenderLevel(width, height, col, row);
+}
+
+wxBitmap SvgImageLuna::RenderLevel(int width, int height, int col, int row)
+{
+    // A render stored on disk is written into the bitmap straight from the
+    // mapped file, like a fresh one; a fresh one is saved first
+    SvgDiskCache::Key key;
+    const bool persist = m_diskCache && GetDiskCacheKey(width, height, col, row, key);
+    SvgDiskCache::Pixels stored;
+    SvgRenderBuffer buffer; // pooled memory for a fresh render
+    const lunasvg::Bitmap* pixels = &stored.GetBitmap();
+    if (!persist || !m_diskCache->Load(key, stored))
+    {
+        bool ok;
+        {
+            std::lock_guard<std::mutex> lock(*m_shared->mutex);
+            ok = Rasterize(*m_shared->document, width, height, col, row, buffer);
+        }
+        if (!ok)
+            return wxBitmap();
+        if (persist)
+            m_diskCache->Save(key, buffer.GetBitmap());
+        pixels = &buffer.GetBitmap();
+    }
+
+    SvgHitMask mask;
+    wxBitmap bmp = ConvertToBitmap(*pixels, mask);
+    if (bmp.IsOk())
+        StoreLevel(bmp, mask, width, height, col < 0 ? SvgBitmapCache::WholeImage : GetTileIndex(width, col, row));
+    return bmp;
+}
+
+bool SvgImageLuna::Rasterize(const lunasvg::Document& document, int width, int height, int col, int row,
+                             SvgRenderBuffer& out)
+{
+    const wxRect rect = col < 0 ? wxRect(0, 0, width, height) : GetTileRect(width, height, col, row);
+    if (rect.IsEmpty() || document.width() <= 0 || document.height() <= 0)
+        return false;
+
+    SvgProfileScope profile("rasterize", SvgProfiler::Rasterize, rect.width, rect.height);
+    out = SvgRenderBuffer(rect.width, rect.height);
+    if (!out.IsOk())
+        return false;
+
+    // Same mapping as renderToBitmap(width, height), shifted so the tile's corner is the origin
+    const lunasvg::Matrix matrix(width / document.width(), 0, 0, height / document.height(),
+                                 static_cast<float>(-rect.x), static_cast<float>(-rect.y));
+    document.render(out.GetBitmap(), matrix);
+    return true;
+}
+
+bool SvgImageLuna::GetDiskCacheKey(int width, int height, int col, int row, SvgDiskCache::Key& key) const
+{
+    if (!Materialize() || m_shared->edited)
+        return false;
+
+    key.hash = m_shared->hash;
+    key.checkHash = m_shared->checkHash;
+    key.width = width;
+    key.height = height;
+    key.tile = col < 0 ? SvgBitmapCache::WholeImage : GetTileIndex(width, col, row);
+    key.renderer = SvgDiskCache::GetRendererVersion();
+    key.options = DiskRenderOptions;
+    return true;
+}
+
+wxBitmap SvgImageLuna::GetCachedBitmap(int width, int height, double WXUNUSED(scale)) const
+{
+    const SvgBitmapCache::Entry* level = GetCache().Find(GetCacheKey(), width, height,
+                                                         SvgBitmapCache::WholeImage, GetGeneration(), true);
+    return level ? level->bitmap : wxBitmap();
+}
+
+wxBitmap SvgImageLuna::GetNearestBitmap(int width, int height) const
+{
+    const SvgBitmapCache::Entry* level = GetCache().FindNearest(GetCacheKey(), width, height, GetGeneration());
+    return level ? level->bitmap : wxBitmap();
+}
+
+void SvgImageLuna::ReleaseCachedBitmap(int width, int height)
+{
+    GetCache().ReleaseBitmap(GetCacheKey(), width, height, SvgBitmapCache::WholeImage, GetGeneration());
+}
+
+bool SvgImageLuna::GetAverageColor(uint32_t& argb) const
+{
+    if (!Materialize())
+        return false;
+
+    SvgSharedDocument& shared = *m_shared;
+    if (shared.averageGeneration != shared.generation)
     {
-        return m_cachedBitmap;
+        const wxSize size = GetThumbnailSize(AverageSampleSide);
+        SvgRenderBuffer buffer;
+        bool ok;
+        {
+            std::lock_guard<std::mutex> lock(*shared.mutex);
+            ok = Rasterize(*shared.document, size.x, size.y, -1, -1, buffer);
+        }
+
+        // Premultiplied BGRA, so plain sums weigh each pixel's colour by its coverage
+        uint64_t sums[4] = { 0, 0, 0, 0 };
+        if (ok)
+        {
+            const lunasvg::Bitmap& lbmp = buffer.GetBitmap();
+            for (int y = 0; y < lbmp.height(); ++y)
+            {
+                const unsigned char* p = lbmp.data() + static_cast<size_t>(y) * lbmp.stride();
+                for (int x = 0; x < lbmp.width(); ++x, p += 4)
+                {
+                    for (int c = 0; c < 4; ++c)
+                        sums[c] += p[c];
+                }
+            }
+        }
+
+        const uint64_t count = static_cast<uint64_t>(size.x) * size.y;
+        shared.averageColor = ok ? static_cast<uint32_t>((sums[3] / count) << 24 | (sums[2] / count) << 16
+                                                         | (sums[1] / count) << 8 | sums[0] / count)
+                                 : 0;
+        shared.averageGeneration = shared.generation;
     }
 
-    // Render using lunasvg
-    lunasvg::Bitmap lbmp = m_document->renderToBitmap(width, height);
-    if (!lbmp.valid())
-        return wxBitmap();
+    argb = shared.averageColor;
+    return true;
+}
+
+wxSize SvgImageLuna::GetThumbnailSize(int side) const
+{
+    const std::shared_ptr<lunasvg::Document> document = GetDocument();
+    if (!document || document->width() <= 0 || document->height() <= 0)
+        return wxSize(side, side);
+
+    const double scale = side / std::max(document->width(), document->height());
+    return wxSize(std::max(1, static_cast<int>(std::round(document->width() * scale))),
+                  std::max(1, static_cast<int>(std::round(document->height() * scale))));
+}
+
+wxBitmap SvgImageLuna::GetLastBitmap() const
+{
+    const SvgBitmapCache::Entry* level = GetCache().FindLast(GetCacheKey());
+    return level ? level->bitmap : wxBitmap();
+}
+
+const SvgHitMask* SvgImageLuna::GetHitMask(int width, int height) const
+{
+    // Levels moved into the atlas still answer: they keep their mask
+    const SvgBitmapCache::Entry* level = GetCache().FindMask(GetCacheKey(), width, height, GetGeneration());
+    return level ? &level->mask : nullptr;
+}
 
+bool SvgImageLuna::HitTestLocal(int x, int y, int width, int height, bool tiled) const
+{
+    const SvgHitMask* mask = GetHitMask(width, height);
+    if (width <= 0 || height <= 0)
+        return false;
+
+    // The whole image at this exact size answers exactly
+    if (mask && mask->GetWidth() == width && mask->GetHeight() == height)
+        return mask->Test(x, y);
+
+    // Drawn tiled: the cached tile under the point does, if there is one
+    if (tiled && x >= 0 && y >= 0 && x < width && y < height)
+    {
+        const int col = x / TileSize;
+        const int row = y / TileSize;
+        const SvgBitmapCache::Entry* tile = GetCache().Find(GetCacheKey(), width, height,
+                                                            GetTileIndex(width, col, row), GetGeneration());
+        if (tile)
+            return tile->mask.Test(x - col * TileSize, y - row * TileSize);
+    }
+
+    if (!mask || mask->IsEmpty())
+        return false;
+    return mask->Test(x * mask->GetWidth() / width, y * mask->GetHeight() / height);
+}
+
+void SvgImageLuna::StoreLevel(const wxBitmap& bitmap, SvgHitMask& mask, int width, int height, int tile)
+{
+    GetCache().Store(GetCacheKey(), bitmap, mask, width, height, tile, GetGeneration(), MaxCacheLevels);
+    m_dirty = false;
+}
+
+bool SvgImageLuna::AcceptPixels(const lunasvg::Bitmap& pixels, int width, int height, int col, int row, unsigned generation)
+{
+    if (generation != GetGeneration() || !pixels.valid())
+        return false;
+
+    SvgHitMask mask;
+    wxBitmap bmp = ConvertToBitmap(pixels, mask);
+    if (!bmp.IsOk())
+        return false;
+
+    StoreLevel(bmp, mask, width, height, col < 0 ? SvgBitmapCache::WholeImage : GetTileIndex(width, col, row));
+    return true;
+}
+
+static void ConvertBitmapToImage(const lunasvg::Bitmap& lbmp, wxImage& img, SvgHitMask& mask,
+                                 SvgRenderBufferPool::Lease& planes)
+{
     const unsigned char* src = lbmp.data();
     const int stride = lbmp.stride();
     const int w = lbmp.width();
     const int h = lbmp.height();
 
+    // RGB then alpha in one block; static data, so wxImage neither copies nor frees it
+    const size_t pixels = static_cast<size_t>(w) * h;
+    planes = SvgRenderBufferPool::Get().Acquire(pixels * 4);
+    unsigned char* rgb = planes.GetData();
+    unsigned char* alpha = rgb + pixels * 3;
+    img = wxImage(w, h, rgb, alpha, true);
+
+    mask.Reset(w, h);
+    SvgPixelConvert::BgraToRgbAlpha(src, stride, w, h, rgb, alpha, &mask);
+}
+
+static wxBitmap ConvertToBitmap(const lunasvg::Bitmap& lbmp, SvgHitMask& mask)
+{
+    const int w = lbmp.width();
+    const int h = lbmp.height();
+    SvgProfileScope profile("convert", SvgProfiler::Convert, w, h);
+
 #ifdef __WXMSW__
+    const unsigned char* src = lbmp.data();
+    const int stride = lbmp.stride();
+
     // Try the fast MSW DIB path when stride is DWORD-aligned
     // (SetDIBits expects aligned scanlines for 32bpp DIB usage)
     if (stride % sizeof(LONG) == 0)
@@ -109,70 +578,66 @@ wxBitmap SvgImageLuna::Render(int width, int height, double scale)
         {
             // Ensure wxWidgets treats the bitmap as having alpha
             bmp.UseAlpha();
-            m_cachedBitmap = bmp;
-            m_cachedWidth = width;
-            m_cachedHeight = height;
-            m_cachedScale = scale;
-            m_dirty = false;
-            return m_cachedBitmap;
+            mask.BuildFromBgra(src, stride, w, h);
+            return bmp;
         }
         // else fall through to safe (per-pixel) path
     }
 #endif // __WXMSW__
 
-    // Fallback: safe, portable path with BGRA -> RGB and unpremultiply alpha
-    wxImage img(w, h, false);
-    img.SetAlpha(); // ensures alpha buffer exists
-
-    unsigned char* rgb = img.GetData();
-    unsigned char* alpha = img.GetAlpha();
-
-    for (int y = 0; y < h; ++y)
+    // Straight into the native bitmap's pixel storage in one pass, with no
+    // intermediate wxImage (which wxBitmap would convert a second time)
     {
-        const unsigned char* row = src + y * stride;
-        for (int x = 0; x < w; ++x)
+        wxBitmap bmp(w, h, 32);
+        if (bmp.IsOk())
         {
-            unsigned char b = row[0];
-            unsigned char g = row[1];
-            unsigned char r = row[2];
-            unsigned char a = row[3];
-
-            // Unpremultiply (lunasvg outputs premultiplied alpha)
-            if (a != 0)
-            {
-                // Use integer math to avoid floating point
-                r = static_cast<unsigned char>((r * 255) / a);
-                g = static_cast<unsigned char>((g * 255) / a);
-                b = static_cast<unsigned char>((b * 255) / a);
-            }
-
-            *rgb++ = r;
-            *rgb++ = g;
-            *rgb++ = b;
-            *alpha++ = a;
-
-            row += 4;
+            bmp.UseAlpha();
+            mask.Reset(w, h);
+            if (WriteToBitmap(lbmp, bmp, 0, 0, &mask))
+                return bmp;
         }
     }
 
-    m_cachedBitmap = wxBitmap(img);
-    m_cachedWidth = width;
-    m_cachedHeight = height;
-    m_cachedScale = scale;
-    m_dirty = false;
-
-    return m_cachedBitmap;
+    // Fallback: safe, portable path with BGRA -> RGB and unpremultiply alpha.
+    // wxBitmap copies the image, so the planes can go back to the pool after.
+    SvgRenderBufferPool::Lease planes;
+    wxImage img;
+    ConvertBitmapToImage(lbmp, img, mask, planes);
+    return wxBitmap(img);
 }
 
-wxBitmap SvgImageLuna::GetCachedBitmap(int width, int height, double scale) const
+static bool WriteToBitmap(const lunasvg::Bitmap& lbmp, wxBitmap& bmp, int x, int y, SvgHitMask* mask)
 {
-    if (!m_cachedBitmap.IsOk()) return wxBitmap();
-    if (!m_dirty &&
-        m_cachedWidth == width &&
-        m_cachedHeight == height &&
-        m_cachedScale == scale)
+    typedef wxAlphaPixelData::PixelFormat Format;
+    static_assert(Format::BitsPerPixel == 32, "native alpha pixels are expected to be 4 bytes");
+
+    const int w = lbmp.width();
+    const int h = lbmp.height();
+    wxAlphaPixelData data(bmp, wxRect(x, y, w, h));
+    if (!data)
+        return false;
+
+    // Channel order of the native storage. Premultiplied where the backend keeps
+    // it that way (MSW, macOS): lunasvg output then goes in as it is.
+    SvgPixelConvert::PixelLayout layout;
+    layout.red = Format::RED;
+    layout.green = Format::GREEN;
+    layout.blue = Format::BLUE;
+    layout.alpha = Format::ALPHA;
+#ifdef wxHAS_PREMULTIPLIED_ALPHA
+    layout.premultiplied = true;
+#else
+    layout.premultiplied = false; // e.g. GTK: straight alpha, unpremultiplied as BgraToRgbAlpha does it
+#endif
+
+    // Rows are walked through the iterator: their stride may be negative (bottom-up DIBs)
+    wxAlphaPixelData::Iterator rowStart(data);
+    for (int row = 0; row < h; ++row)
     {
-        return m_cachedBitmap;
+        SvgPixelConvert::BgraToPixelRow(lbmp.data() + row * lbmp.stride(), w,
+                                        reinterpret_cast<unsigned char*>(rowStart.m_ptr), layout,
+                                        mask ? mask->GetRowBits(row) : nullptr);
+        rowStart.OffsetY(data, 1);
     }
-    return wxBitmap();
+    return true;
 }
@@ -1,48 +1,195 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include <wx/bitmap.h>
+#include <wx/image.h>
 #include "lunasvg.h"
+#include "svg_hit_mask.h"
+#include "svg_bitmap_cache.h"
+#include "svg_disk_cache.h"
+#include "svg_document_store.h"
+#include "svg_render_buffer.h"
 
-// Minimal wrapper: exposes document, supports load, render, dirty flag, per-scale caching.
+// Source of a document not parsed yet, shared by every image restored from it
+// (see SvgImageLuna::SetDeferredSource)
+struct SvgDeferredSource
+{
+    std::shared_ptr<const std::string> text;
+    std::string path;               // file it was originally loaded from, informational
+    std::vector<SvgDomEdit> edits;  // replayed after parsing
+};
+
+// Minimal wrapper: exposes document, supports load, render, dirty flag, per-size caching.
+// Keeps a few rendered resolutions (like a mipmap pyramid) so zooming back and
+// forth between common levels re-uses earlier renders. The bitmaps live in a
+// SvgBitmapCache, normally shared by every image on a canvas so one memory budget
+// covers them all; an image without one gets a private, unbounded cache.
+// Images loaded from identical text share one parsed document (SvgDocumentStore)
+// and its cached renders until one of them is edited (copy-on-write).
+// With a SvgDiskCache, renders of unedited documents also persist across runs.
 class SvgImageLuna
 {
 public:
+    enum { MaxCacheLevels = 6 }; // rendered sizes kept per image, least recently used evicted
+    enum { TileSize = 256 };     // edge of a tile in tiled rendering
+    enum { AverageSampleSide = 16 }; // render the average colour is taken from
+    enum { DiskRenderOptions = 1 };  // disk cache key: bump when the way renders are made changes
+
     SvgImageLuna();
-    ~SvgImageLuna() = default;
+    ~SvgImageLuna();
+
+    SvgImageLuna(const SvgImageLuna&) = delete;
+    SvgImageLuna& operator=(const SvgImageLuna&) = delete;
+
+    // Move this image's renders into 'cache' (dropping any held elsewhere)
+    void SetBitmapCache(const std::shared_ptr<SvgBitmapCache>& cache);
+
+    // Owner key of this image's cache entries: the shared document, so every
+    // image showing it reuses the same renders
+    const void* GetCacheKey() const { return m_shared ? static_cast<const void*>(m_shared.get()) : this; }
+
+    // Persist renders in 'cache' (nullptr to stop)
+    void SetDiskCache(const std::shared_ptr<SvgDiskCache>& cache) { m_diskCache = cache; }
+    const std::shared_ptr<SvgDiskCache>& GetDiskCache() const { return m_diskCache; }
+
+    // Disk cache key of the whole image (col < 0) or one tile at width x height.
+    // False once the document was handed out for editing: its source no longer describes it.
+    bool GetDiskCacheKey(int width, int height, int col, int row, SvgDiskCache::Key& key) const;
 
     // Load SVG
     bool LoadFromFile(const std::string& filePath);
     bool LoadFromString(const std::string& svgText);
 
-    // Document access
-    std::shared_ptr<lunasvg::Document> GetDocument() const { return m_document; }
+    // Lazy load: keep the source and parse it only when the document is first
+    // needed (document access, rendering). Sources without edits are interned.
+    void SetDeferredSource(const std::shared_ptr<const SvgDeferredSource>& source);
+    const std::shared_ptr<const SvgDeferredSource>& GetDeferredSource() const { return m_deferred; } // until parsed
+    bool IsLoaded() const { return m_shared != nullptr; }
+
+    // Parsed document with its source hashes and recorded edits, without
+    // forcing a deferred source to load (nullptr then)
+    const std::shared_ptr<SvgSharedDocument>& GetSharedDocument() const { return m_shared; }
+
+    // Read-only document access; it may be shared with other images.
+    std::shared_ptr<lunasvg::Document> GetDocument() const { return Materialize() ? m_shared->document : nullptr; }
+
+    // Document to mutate through the DOM API: detaches this image from the shared
+    // copy first. Background renders may be reading it, so hold LockDocument()
+    // while mutating, then MarkDirty(). nullptr if the source text was released
+    // and its file has changed since.
+    std::shared_ptr<lunasvg::Document> GetDocumentForEdit();
+
+    // Edit through GetDocumentForEdit(), under the lock, recording the edit so the
+    // document can be rebuilt from its source (scene snapshots). Returns the
+    // number of nodes changed. Marks the image dirty if anything changed, unless
+    // 'area' is given: the changed area is then added to it, for RepaintArea().
+    size_t ApplyEdit(const SvgDomEdit& edit, SvgDirtyArea* area = nullptr);
+
+    // After edits that changed only 'area': re-rasterize just that part of every
+    // current render and tile, in place, and keep them current. A whole area marks
+    // the image dirty instead. Returns false if some render could not be patched,
+    // or there was none; those are left stale and re-rendered when next drawn.
+    bool RepaintArea(const SvgDirtyArea& area);
 
-    // Mark as modified externally
-    void MarkDirty() { m_dirty = true; }
+    std::unique_lock<std::mutex> LockDocument() const
+    {
+        return Materialize() ? std::unique_lock<std::mutex>(*m_shared->mutex) : std::unique_lock<std::mutex>();
+    }
+    std::shared_ptr<std::mutex> GetDocumentMutex() const { return Materialize() ? m_shared->mutex : nullptr; }
 
-    // Render at exact pixel size (width, height). This updates the internal cache
-    // and cachedScale (scale is user logical scale factor; for our usage we'll use zoom as scale).
+    // Mark as modified externally: every cached level becomes stale and renders
+    // still in flight are dropped when they arrive.
+    void MarkDirty();
+    unsigned GetGeneration() const { return m_shared ? m_shared->generation : 0; }
+
+    // Render at exact pixel size (width, height) and add it to the cached levels.
+    // (scale is the user logical scale factor, i.e. the zoom; the cache is keyed by size.)
     wxBitmap Render(int width, int height, double scale);
 
-    // Get cached bitmap if matches size and scale; returns invalid bitmap if none.
+    // Get cached bitmap if a current level has exactly this size; returns invalid bitmap if none.
     wxBitmap GetCachedBitmap(int width, int height, double scale) const;
 
+    // Closest current level to (width, height), preferring one at least that big,
+    // to be drawn scaled while the exact size is not rendered yet. Invalid if none.
+    wxBitmap GetNearestBitmap(int width, int height) const;
+
+    // The exact level of this size was copied elsewhere (the canvas bitmap atlas):
+    // drop its bitmap, keeping the level's hit mask. The level then counts as not
+    // rendered for drawing (GetCachedBitmap(), GetNearestBitmap(), GetLastBitmap(),
+    // Render()), so once the atlas drops its copy the next paint renders it again.
+    void ReleaseCachedBitmap(int width, int height);
+
+    // Level-of-detail stand-ins for items drawn a few pixels wide. Both follow the
+    // document, so they are computed once for every image showing it.
+    // Average colour of the drawing over its whole box, premultiplied ARGB, from
+    // a small render made on first use and after each edit. False if no document.
+    bool GetAverageColor(uint32_t& argb) const;
+    // Pixel size of a thumbnail render whose larger side is 'side', in the
+    // document's proportions (render it like any level)
+    wxSize GetThumbnailSize(int side) const;
+
+    // Last successfully rendered bitmap, regardless of size or dirty state.
+    // Useful as a stand-in while a fresh render is pending.
+    wxBitmap GetLastBitmap() const;
+
     bool IsDirty() const { return m_dirty; }
 
+    // Hit mask of the level that best matches (width, height): exact, else nearest
+    // current, else the last render. nullptr if nothing was ever rendered.
+    const SvgHitMask* GetHitMask(int width, int height) const;
+
+    // Pixel-perfect picking at local (x, y) of the image drawn at width x height,
+    // scaled onto whichever mask GetHitMask() picks. An image drawn 'tiled' is
+    // tested on the cached tile under the point when it has no whole-image mask
+    // of that size. Constant time, no allocation.
+    bool HitTestLocal(int x, int y, int width, int height, bool tiled = false) const;
+
+    // Tiled rendering, for sizes too large to keep as one bitmap: the image drawn at
+    // width x height is cut into TileSize squares (smaller along the right and bottom
+    // edges), each rasterized through a translated matrix and cached on its own.
+    static wxRect GetTileRect(int width, int height, int col, int row); // in image pixels
+    wxBitmap GetCachedTile(int width, int height, int col, int row) const; // invalid if not cached
+    wxBitmap RenderTile(int width, int height, int col, int row);
+
+    // Async halves. Worker thread: rasterize lunasvg's premultiplied pixels (the
+    // whole image for col < 0, else one tile) into a pooled buffer; touches no wx
+    // GUI objects, caller must hold the document mutex. UI thread: write them, or
+    // the same layout loaded from the disk cache, straight into a native bitmap,
+    // building the hit mask in the same pass, and adopt it as the cached level.
+    // AcceptPixels returns false (and drops them) if the document changed since 'generation'.
+    static bool Rasterize(const lunasvg::Document& document, int width, int height, int col, int row,
+                          SvgRenderBuffer& out);
+    bool AcceptPixels(const lunasvg::Bitmap& pixels, int width, int height, int col, int row, unsigned generation);
+
 private:
-    bool ParseDocument(); // (re)parse m_svgText
+    void SetDocument(const std::shared_ptr<SvgSharedDocument>& shared);
+    bool Materialize() const; // parse a deferred source; true if there is a document
+    void ReleaseCachedLevels(); // drop our entries unless another image still shows them
+
+    SvgBitmapCache& GetCache() const;
+    void StoreLevel(const wxBitmap& bitmap, SvgHitMask& mask, int width, int height, int tile);
+
+    static int GetTileIndex(int width, int col, int row) { return row * ((width + TileSize - 1) / TileSize) + col; }
+
+    // Re-rasterize 'area' of one cached render into its bitmap and mask
+    static bool PatchEntry(const lunasvg::Document& document, SvgBitmapCache::Entry& entry, const SvgDirtyArea& area);
+
+    // Rasterize the whole image (col < 0) or one tile, or load it from the disk
+    // cache (saving it there when rasterized), and store it as a level
+    wxBitmap RenderLevel(int width, int height, int col, int row);
 
 private:
-    std::string m_svgText;
-    std::shared_ptr<lunasvg::Document> m_document;
-
-    // Cached bitmap for last Render()
-    mutable wxBitmap m_cachedBitmap;
-    mutable int m_cachedWidth;
-    mutable int m_cachedHeight;
-    mutable double m_cachedScale;
-    mutable bool m_dirty;
+    // Source, parsed document, its mutex and generation; parsed on first use
+    // from m_deferred when restored lazily
+    mutable std::shared_ptr<SvgSharedDocument> m_shared;
+    mutable std::shared_ptr<const SvgDeferredSource> m_deferred;
+
+    // Rendered levels, keyed by GetCacheKey(); created on first use if never set
+    mutable std::shared_ptr<SvgBitmapCache> m_cache;
+    std::shared_ptr<SvgDiskCache> m_diskCache;
+    bool m_dirty;
 };
@@ -0,0 +1,253 @@
+#include "svg_item_store.h"
+
+#include <algorithm>
+
+SvgItemStore::SvgItemStore()
+    : m_count(0)
+    , m_nextZOrder(0)
+{
+}
+
+SvgItemHandle SvgItemStore::Add(std::unique_ptr<SvgItem> item, const wxPoint& pos, const wxSize& baseSize)
+{
+    uint32_t slot;
+    if (!m_freeSlots.empty())
+    {
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    }
+    else
+    {
+        slot = GetSlotCount();
+        m_x.push_back(0);
+        m_y.push_back(0);
+        m_baseWidth.push_back(0);
+        m_baseHeight.push_back(0);
+        m_labelWidth.push_back(0);
+        m_labelHeight.push_back(0);
+        m_left.push_back(0);
+        m_top.push_back(0);
+        m_right.push_back(0);
+        m_bottom.push_back(0);
+        m_zOrder.push_back(0);
+        m_flags.push_back(0);
+        m_generations.push_back(1);
+        m_items.emplace_back();
+    }
+
+    m_x[slot] = pos.x;
+    m_y[slot] = pos.y;
+    m_baseWidth[slot] = baseSize.x;
+    m_baseHeight[slot] = baseSize.y;
+    m_labelWidth[slot] = 0;
+    m_labelHeight[slot] = 0;
+    m_left[slot] = m_top[slot] = m_right[slot] = m_bottom[slot] = 0;
+    m_zOrder[slot] = m_nextZOrder++;
+    m_flags[slot] = Live | Visible;
+    m_items[slot] = std::move(item);
+    ++m_count;
+    return GetHandle(slot);
+}
+
+void SvgItemStore::Remove(SvgItemHandle handle)
+{
+    if (!IsValid(handle))
+        return;
+
+    const uint32_t slot = handle.slot;
+    const SvgItem& item = *m_items[slot];
+    if (item.renderPending || !item.pendingTiles.empty())
+        m_pending.erase(std::find(m_pending.begin(), m_pending.end(), slot));
+    m_flags[slot] = 0;
+    m_items[slot].reset();
+    if (++m_generations[slot] == 0)
+        m_generations[slot] = 1; // 0 is no item
+    m_freeSlots.push_back(slot);
+    --m_count;
+}
+
+void SvgItemStore::Clear()
+{
+    for (uint32_t slot = 0; slot < GetSlotCount(); ++slot)
+    {
+        if (IsLive(slot))
+            Remove(GetHandle(slot));
+    }
+}
+
+bool SvgItemStore::AddPendingRender(uint32_t slot, int col, int row)
+{
+    SvgItem& item = *m_items[slot];
+    const bool wasPending = item.renderPending || !item.pendingTiles.empty();
+    if (col >= 0)
+    {
+        if (!item.pendingTiles.insert(std::make_pair(col, row)).second)
+            return false;
+    }
+    else
+    {
+        if (item.renderPending)
+            return false;
+        item.renderPending = true;
+    }
+
+    if (!wasPending)
+        m_pending.push_back(slot);
+    return true;
+}
+
+void SvgItemStore::RemovePendingRender(uint32_t slot, int col, int row)
+{
+    SvgItem& item = *m_items[slot];
+    if (!item.renderPending && item.pendingTiles.empty())
+        return;
+
+    if (col >= 0)
+        item.pendingTiles.erase(std::make_pair(col, row));
+    else
+        item.renderPending = false;
+
+    if (!item.renderPending && item.pendingTiles.empty())
+        m_pending.erase(std::find(m_pending.begin(), m_pending.end(), slot));
+}
+
+void SvgItemStore::ClearPendingRenders()
+{
+    for (uint32_t slot : m_pending)
+    {
+        SvgItem& item = *m_items[slot];
+        item.renderPending = false;
+        item.pendingTiles.clear();
+    }
+    m_pending.clear();
+}
+
+void SvgItemStore::Reserve(size_t count)
+{
+    m_x.reserve(count);
+    m_y.reserve(count);
+    m_baseWidth.reserve(count);
+    m_baseHeight.reserve(count);
+    m_labelWidth.reserve(count);
+    m_labelHeight.reserve(count);
+    m_left.reserve(count);
+    m_top.reserve(count);
+    m_right.reserve(count);
+    m_bottom.reserve(count);
+    m_zOrder.reserve(count);
+    m_flags.reserve(count);
+    m_generations.reserve(count);
+    m_items.reserve(count);
+}
+
+SvgItemHandle SvgItemStore::GetHandle(uint32_t slot) const
+{
+    SvgItemHandle handle;
+    if (slot < GetSlotCount() && IsLive(slot))
+    {
+        handle.slot = slot;
+        handle.generation = m_generations[slot];
+    }
+    return handle;
+}
+
+void SvgItemStore::SetVisible(uint32_t slot, bool visible)
+{
+    if (visible)
+        m_flags[slot] |= Visible;
+    else
+        m_flags[slot] &= ~Visible;
+}
+
+wxRect SvgItemStore::ComputeBounds(uint32_t slot, double zoom) const
+{
+    const wxSize size = GetSize(slot, zoom);
+
+    // icon or placeholder, widened by the 2px selection pen
+    wxRect bounds(GetPos(slot), wxSize(std::max(10, size.x), std::max(10, size.y)));
+    bounds.Inflate(2);
+
+    if (m_labelWidth[slot] > 0 && m_labelHeight[slot] > 0)
+        bounds.Union(wxRect(m_x[slot], m_y[slot] + size.y + 4, m_labelWidth[slot], m_labelHeight[slot]));
+
+    return bounds;
+}
+
+void SvgItemStore::UpdateBounds(uint32_t slot, double zoom)
+{
+    const wxRect bounds = ComputeBounds(slot, zoom);
+    m_left[slot] = bounds.x;
+    m_top[slot] = bounds.y;
+    m_right[slot] = bounds.x + bounds.width;
+    m_bottom[slot] = bounds.y + bounds.height;
+}
+
+void SvgItemStore::UpdateAllBounds(double zoom)
+{
+    // ComputeBounds() for every slot, without branches and one edge pair per
+    // loop: each loop reads few enough arrays for the compiler to check them for
+    // overlap and process several slots per instruction
+    const size_t count = m_x.size();
+    const int* x = m_x.data();
+    const int* y = m_y.data();
+    const int* baseWidth = m_baseWidth.data();
+    const int* baseHeight = m_baseHeight.data();
+    const int* labelWidth = m_labelWidth.data();
+    const int* labelHeight = m_labelHeight.data();
+    int* left = m_left.data();
+    int* top = m_top.data();
+    int* right = m_right.data();
+    int* bottom = m_bottom.data();
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        left[i] = x[i] - 2;
+        top[i] = y[i] - 2;
+    }
+
+    // Without a label its rectangle collapses onto the top-left, inside the icon's
+    for (size_t i = 0; i < count; ++i)
+    {
+        const int labelled = (labelWidth[i] > 0) & (labelHeight[i] > 0);
+        right[i] = std::max(x[i] + std::max(10, Scale(baseWidth[i], zoom)) + 2, x[i] + labelWidth[i] * labelled);
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        const int h = Scale(baseHeight[i], zoom);
+        const int labelled = (labelWidth[i] > 0) & (labelHeight[i] > 0);
+        bottom[i] = std::max(y[i] + std::max(10, h) + 2, y[i] + (h + 4 + labelHeight[i]) * labelled);
+    }
+}
+
+void SvgItemStore::Cull(const wxRect& area, std::vector<uint32_t>& out) const
+{
+    if (area.width <= 0 || area.height <= 0)
+        return;
+
+    // Test every slot into a mask first: that loop has no branch and vectorizes,
+    // and the few passing slots are then gathered
+    const size_t count = m_x.size();
+    m_cullMask.resize(count);
+    const int areaLeft = area.x;
+    const int areaTop = area.y;
+    const int areaRight = area.x + area.width;
+    const int areaBottom = area.y + area.height;
+    const int* left = m_left.data();
+    const int* top = m_top.data();
+    const int* right = m_right.data();
+    const int* bottom = m_bottom.data();
+    const uint8_t* flags = m_flags.data();
+    uint8_t* mask = m_cullMask.data();
+    for (size_t i = 0; i < count; ++i)
+    {
+        mask[i] = static_cast<uint8_t>(((flags[i] & Visible) != 0) &
+                                       (left[i] < areaRight) & (right[i] > areaLeft) &
+                                       (top[i] < areaBottom) & (bottom[i] > areaTop));
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (mask[i])
+            out.push_back(static_cast<uint32_t>(i));
+    }
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include <wx/gdicmn.h>
+#include <wx/string.h>
+
+#include "svg_image_luna.h"
+
+// Refers to one item of a SvgItemStore: its slot and the generation the slot had
+// when the item was added. Once the item is removed the slot's generation moves
+// on, so a handle kept past that resolves to nothing rather than to whichever
+// item reuses the slot. A default handle refers to no item.
+struct SvgItemHandle
+{
+    uint32_t slot = 0;
+    uint32_t generation = 0; // 0: no item
+
+    bool IsOk() const { return generation != 0; }
+    bool operator==(const SvgItemHandle& other) const { return slot == other.slot && generation == other.generation; }
+    bool operator!=(const SvgItemHandle& other) const { return !(*this == other); }
+};
+
+// Per-item data only touched once an item is known to be drawn, rendered or edited
+struct SvgItem
+{
+    SvgImageLuna svg;    // svg doc + render cache
+    wxString label;      // label to draw under icon
+    // Async render state, changed through SvgItemStore::AddPendingRender() and co.
+    bool renderPending = false; // async render queued/running for this item
+    std::set<std::pair<int, int>> pendingTiles; // (col, row) of async tile renders queued/running
+    unsigned atlasRefusedGeneration = 0;        // generation the atlas last had no room for, 0 if none
+    unsigned long long atlasRefusedFrees = 0;   // SvgBitmapAtlas::GetFreeCount() when it refused
+};
+
+// The canvas items, stored by column. Geometry, flags and paint order, read by
+// every cull, hit test and bounds pass, live in one contiguous array each, indexed
+// by slot; the document, label text and render state (SvgItem) are held apart, one
+// allocation per item, and read only for the items that pass. Passes over every
+// slot are plain loops over the arrays, with no pointer to chase.
+//
+// Slots of removed items are reused; SvgItemHandle tells a live item from an old
+// one. Positions are canvas coordinates, sizes are at zoom 1.
+// UI thread only.
+class SvgItemStore
+{
+public:
+    SvgItemStore();
+
+    SvgItemStore(const SvgItemStore&) = delete;
+    SvgItemStore& operator=(const SvgItemStore&) = delete;
+
+    // Add a visible item, painted above every item added before it. Its label
+    // size and stored bounds start empty.
+    SvgItemHandle Add(std::unique_ptr<SvgItem> item, const wxPoint& pos, const wxSize& baseSize);
+    void Remove(SvgItemHandle handle);
+    void Clear(); // every handle goes stale
+    void Reserve(size_t count);
+
+    bool IsValid(SvgItemHandle handle) const
+    {
+        return handle.IsOk() && handle.slot < m_generations.size() && m_generations[handle.slot] == handle.generation;
+    }
+    SvgItem* Get(SvgItemHandle handle) const { return IsValid(handle) ? m_items[handle.slot].get() : nullptr; }
+    SvgItemHandle GetHandle(uint32_t slot) const;
+
+    // Slots in use or free; a free slot is never live or visible
+    uint32_t GetSlotCount() const { return static_cast<uint32_t>(m_generations.size()); }
+    size_t GetCount() const { return m_count; }
+    bool IsLive(uint32_t slot) const { return (m_flags[slot] & Live) != 0; }
+
+    // Cold data of a live slot
+    SvgItem& GetItem(uint32_t slot) const { return *m_items[slot]; }
+
+    // Hot columns
+    wxPoint GetPos(uint32_t slot) const { return wxPoint(m_x[slot], m_y[slot]); }
+    void SetPos(uint32_t slot, const wxPoint& pos) { m_x[slot] = pos.x; m_y[slot] = pos.y; }
+    wxSize GetBaseSize(uint32_t slot) const { return wxSize(m_baseWidth[slot], m_baseHeight[slot]); }
+    wxSize GetLabelSize(uint32_t slot) const { return wxSize(m_labelWidth[slot], m_labelHeight[slot]); }
+    void SetLabelSize(uint32_t slot, const wxSize& size) { m_labelWidth[slot] = size.x; m_labelHeight[slot] = size.y; }
+    bool IsVisible(uint32_t slot) const { return (m_flags[slot] & Visible) != 0; }
+    void SetVisible(uint32_t slot, bool visible);
+    unsigned GetZOrder(uint32_t slot) const { return m_zOrder[slot]; }
+
+    // Pixel size of an item at 'zoom': base size scaled, rounded to nearest
+    static int Scale(int base, double zoom) { return static_cast<int>(base * zoom + 0.5); }
+    wxSize GetSize(uint32_t slot, double zoom) const
+    {
+        return wxSize(Scale(m_baseWidth[slot], zoom), Scale(m_baseHeight[slot], zoom));
+    }
+
+    // Icon (at least 10 pixels a side) and the label under it, widened by the
+    // 2px selection frame, at 'zoom'
+    wxRect ComputeBounds(uint32_t slot, double zoom) const;
+
+    // Bounds as last stored, by UpdateBounds() or UpdateAllBounds(): what the
+    // spatial index and scene extent hold. Right and bottom are exclusive.
+    wxRect GetBounds(uint32_t slot) const
+    {
+        return wxRect(m_left[slot], m_top[slot], m_right[slot] - m_left[slot], m_bottom[slot] - m_top[slot]);
+    }
+    int GetBoundsRight(uint32_t slot) const { return m_right[slot]; }
+    int GetBoundsBottom(uint32_t slot) const { return m_bottom[slot]; }
+    void UpdateBounds(uint32_t slot, double zoom);
+    void UpdateAllBounds(double zoom); // one pass over every slot
+
+    // Append visible slots whose stored bounds intersect 'area', in slot order, by
+    // scanning the bounds columns. For areas covering much of the scene, where a
+    // spatial index would visit nearly everything anyway.
+    void Cull(const wxRect& area, std::vector<uint32_t>& out) const;
+
+    // Async renders (SvgItem::renderPending, pendingTiles; col < 0 for the whole
+    // image), tracked here too so the items waiting on one are known without a
+    // pass over every slot. Add returns false if that render is already pending.
+    bool AddPendingRender(uint32_t slot, int col, int row);
+    void RemovePendingRender(uint32_t slot, int col, int row);
+    void ClearPendingRenders();
+    bool HasPendingRenders() const { return !m_pending.empty(); }
+
+private:
+    enum { Live = 1 << 0, Visible = 1 << 1 };
+
+private:
+    // Hot columns, one entry per slot
+    std::vector<int> m_x;
+    std::vector<int> m_y;
+    std::vector<int> m_baseWidth;
+    std::vector<int> m_baseHeight;
+    std::vector<int> m_labelWidth;   // measured text extent of the label, 0 if none
+    std::vector<int> m_labelHeight;
+    std::vector<int> m_left;         // stored bounds
+    std::vector<int> m_top;
+    std::vector<int> m_right;
+    std::vector<int> m_bottom;
+    std::vector<unsigned> m_zOrder;  // paint order; higher is on top
+    std::vector<uint8_t> m_flags;
+    std::vector<uint32_t> m_generations;
+
+    // Cold data, nullptr in free slots
+    std::vector<std::unique_ptr<SvgItem>> m_items;
+
+    std::vector<uint32_t> m_freeSlots;
+    std::vector<uint32_t> m_pending; // slots with an async render pending, each once
+    size_t m_count;
+    unsigned m_nextZOrder;
+    mutable std::vector<uint8_t> m_cullMask; // scratch for Cull()
+};
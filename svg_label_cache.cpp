@@ -0,0 +1,111 @@
+#include "svg_label_cache.h"
+
+#include <wx/dcmemory.h>
+#include <wx/image.h>
+
+SvgLabelCache::SvgLabelCache(size_t budgetBytes)
+    : m_budget(budgetBytes)
+    , m_bytes(0)
+    , m_hits(0)
+    , m_misses(0)
+{
+}
+
+const wxBitmap& SvgLabelCache::Get(const wxString& text, const wxFont& font, const wxColour& colour)
+{
+    if (text.IsEmpty())
+        return m_none;
+
+    const std::string key = MakeKey(text, font, colour);
+    auto found = m_entries.find(key);
+    if (found != m_entries.end())
+    {
+        ++m_hits;
+        m_lru.splice(m_lru.begin(), m_lru, found->second.lru);
+        return found->second.bitmap;
+    }
+
+    ++m_misses;
+    Entry entry;
+    entry.bitmap = Render(text, font, colour);
+    entry.bytes = entry.bitmap.IsOk() ? static_cast<size_t>(entry.bitmap.GetWidth()) * entry.bitmap.GetHeight() * 4 : 0;
+
+    // Make room, never evicting the label about to be returned
+    while (m_bytes + entry.bytes > m_budget && !m_lru.empty())
+    {
+        auto oldest = m_entries.find(m_lru.back());
+        m_bytes -= oldest->second.bytes;
+        m_entries.erase(oldest);
+        m_lru.pop_back();
+    }
+
+    m_lru.push_front(key);
+    entry.lru = m_lru.begin();
+    m_bytes += entry.bytes;
+    return m_entries.emplace(key, std::move(entry)).first->second.bitmap;
+}
+
+void SvgLabelCache::Clear()
+{
+    m_entries.clear();
+    m_lru.clear();
+    m_bytes = 0;
+}
+
+SvgLabelCache::Stats SvgLabelCache::GetStats() const
+{
+    Stats stats;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.entries = m_entries.size();
+    stats.bytes = m_bytes;
+    return stats;
+}
+
+std::string SvgLabelCache::MakeKey(const wxString& text, const wxFont& font, const wxColour& colour)
+{
+    // Text last: it may contain the separator, the font description and colour cannot
+    std::string key = font.GetNativeFontInfoDesc().utf8_string();
+    key += '\n';
+    key += std::to_string(colour.GetRGBA());
+    key += '\n';
+    key += text.utf8_string();
+    return key;
+}
+
+wxBitmap SvgLabelCache::Render(const wxString& text, const wxFont& font, const wxColour& colour)
+{
+    wxBitmap probe(1, 1);
+    wxMemoryDC dc(probe);
+    dc.SetFont(font);
+    const wxSize size = dc.GetMultiLineTextExtent(text);
+    if (size.x <= 0 || size.y <= 0)
+        return wxBitmap();
+
+    // White on black: each pixel's brightness is the text's coverage there
+    wxBitmap coverage(size.x, size.y, 24);
+    dc.SelectObject(coverage);
+    dc.SetBackground(*wxBLACK_BRUSH);
+    dc.Clear();
+    dc.SetTextForeground(*wxWHITE);
+    dc.DrawText(text, 0, 0);
+    dc.SelectObject(wxNullBitmap);
+
+    // Coverage becomes alpha under a solid colour; subpixel antialiasing
+    // tints the channels, so they are averaged
+    wxImage image = coverage.ConvertToImage();
+    if (!image.IsOk())
+        return wxBitmap();
+    image.SetAlpha();
+    unsigned char* rgb = image.GetData();
+    unsigned char* alpha = image.GetAlpha();
+    const size_t pixels = static_cast<size_t>(size.x) * size.y;
+    for (size_t i = 0; i < pixels; ++i, rgb += 3)
+    {
+        alpha[i] = static_cast<unsigned char>((rgb[0] + rgb[1] + rgb[2]) / 3);
+        rgb[0] = colour.Red();
+        rgb[1] = colour.Green();
+        rgb[2] = colour.Blue();
+    }
+    return wxBitmap(image, 32);
+}
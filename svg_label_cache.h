@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include <wx/bitmap.h>
+#include <wx/colour.h>
+#include <wx/font.h>
+
+// Item labels rendered once into bitmaps, so a paint blits each label instead of
+// laying out its text again. Entries are keyed by text, font and colour: a
+// changed label or font simply misses, and the stale entry ages out. A label is
+// drawn in its colour with antialiased alpha, over whatever is below it, with
+// wxDC::DrawBitmap(bitmap, x, y, true). Past the byte budget the least recently
+// drawn labels are dropped.
+// UI thread only.
+class SvgLabelCache
+{
+public:
+    enum { DefaultBudgetMB = 32 };
+
+    struct Stats
+    {
+        unsigned long long hits;
+        unsigned long long misses;
+        size_t entries;
+        size_t bytes;
+    };
+
+    explicit SvgLabelCache(size_t budgetBytes = size_t(DefaultBudgetMB) << 20);
+
+    SvgLabelCache(const SvgLabelCache&) = delete;
+    SvgLabelCache& operator=(const SvgLabelCache&) = delete;
+
+    // The label, rendered on first use; invalid for empty text. Valid until the next call.
+    const wxBitmap& Get(const wxString& text, const wxFont& font, const wxColour& colour);
+
+    void Clear();
+    Stats GetStats() const;
+
+private:
+    struct Entry
+    {
+        wxBitmap bitmap;
+        size_t bytes;
+        std::list<std::string>::iterator lru;
+    };
+
+    static std::string MakeKey(const wxString& text, const wxFont& font, const wxColour& colour);
+    static wxBitmap Render(const wxString& text, const wxFont& font, const wxColour& colour);
+
+private:
+    size_t m_budget;
+    size_t m_bytes;
+    std::unordered_map<std::string, Entry> m_entries;
+    std::list<std::string> m_lru; // most recently drawn first
+    unsigned long long m_hits;
+    unsigned long long m_misses;
+    wxBitmap m_none;
+};
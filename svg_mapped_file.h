@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file (mmap on POSIX, a file mapping on
+// Windows), so a document can be parsed straight from the page cache without
+// first copying the file into a string.
+class SvgMappedFile
+{
+public:
+    SvgMappedFile() : m_data(nullptr), m_size(0) {}
+    ~SvgMappedFile() { Close(); }
+
+    SvgMappedFile(const SvgMappedFile&) = delete;
+    SvgMappedFile& operator=(const SvgMappedFile&) = delete;
+
+    // Fails for missing, unreadable or empty files and for files that cannot be
+    // mapped (pipes, some network shares); callers fall back to a plain read.
+    bool Open(const std::string& filePath);
+    void Close();
+
+    bool IsOpen() const { return m_data != nullptr; }
+    const char* GetData() const { return m_data; }
+    size_t GetSize() const { return m_size; }
+
+private:
+    const char* m_data;
+    size_t m_size;
+};
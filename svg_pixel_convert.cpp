@@ -0,0 +1,372 @@
+#include "svg_pixel_convert.h"
+#include "svg_hit_mask.h"
+
+#include <cstddef>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+  #define SVG_CONVERT_X86 1
+  #include <immintrin.h>
+  #if defined(__GNUC__) || defined(__clang__)
+    // per-function targets: no global -mavx2 needed, dispatch happens at runtime
+    #define SVG_TARGET_SSE2 __attribute__((target("sse2")))
+    #define SVG_TARGET_AVX2 __attribute__((target("avx2")))
+  #else
+    #include <intrin.h>
+    #define SVG_TARGET_SSE2
+    #define SVG_TARGET_AVX2
+  #endif
+#endif
+
+namespace
+{
+
+// (c * K[a]) >> 16 == (c * 255) / a for every c, a in 0..255, a != 0
+struct ReciprocalTable
+{
+    uint32_t k[256];
+
+    ReciprocalTable()
+    {
+        k[0] = 0;
+        for (uint32_t a = 1; a < 256; ++a)
+            k[a] = ((255u << 16) + a - 1) / a;
+    }
+};
+
+const uint32_t* GetReciprocals()
+{
+    static const ReciprocalTable table;
+    return table.k;
+}
+
+// (float)(c * 255) * ((1.0f / a) * bias), truncated, equals (c * 255) / a for all
+// c, a in 0..255, a != 0. Without the bias 74 pairs come out one too low.
+const float kReciprocalBias = 1.0f + 1.0f / (1 << 18);
+
+void ConvertRowScalar(const unsigned char* src, unsigned char* rgb, unsigned char* alpha,
+                      uint32_t* maskRow, int x, int width)
+{
+    const uint32_t* rcp = GetReciprocals();
+
+    src += x * 4;
+    rgb += x * 3;
+    for (; x < width; ++x)
+    {
+        uint32_t b = src[0];
+        uint32_t g = src[1];
+        uint32_t r = src[2];
+        uint32_t a = src[3];
+
+        // Unpremultiply (lunasvg outputs premultiplied alpha)
+        if (a != 0)
+        {
+            const uint32_t k = rcp[a];
+            r = (r * k) >> 16;
+            g = (g * k) >> 16;
+            b = (b * k) >> 16;
+        }
+
+        rgb[0] = static_cast<unsigned char>(r);
+        rgb[1] = static_cast<unsigned char>(g);
+        rgb[2] = static_cast<unsigned char>(b);
+        alpha[x] = static_cast<unsigned char>(a);
+        if (maskRow && a > SvgHitMask::AlphaThreshold)
+            maskRow[x >> 5] |= 1u << (x & 31);
+
+        src += 4;
+        rgb += 3;
+    }
+}
+
+#ifdef SVG_CONVERT_X86
+
+SVG_TARGET_SSE2 inline __m128i UnpremultiplySSE2(__m128i c, __m128 rcp, __m128i transparent, __m128i lo8)
+{
+    __m128i n = _mm_sub_epi32(_mm_slli_epi32(c, 8), c);                  // c * 255
+    __m128i q = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(n), rcp));
+    q = _mm_and_si128(q, lo8);                                            // unsigned char wrap
+    return _mm_or_si128(_mm_andnot_si128(transparent, q), _mm_and_si128(transparent, c));
+}
+
+// Returns the first pixel left for the scalar tail.
+SVG_TARGET_SSE2 int ConvertRowSSE2(const unsigned char* src, unsigned char* rgb, unsigned char* alpha,
+                                   uint32_t* maskRow, int width)
+{
+    const __m128i lo8 = _mm_set1_epi32(0xFF);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i threshold = _mm_set1_epi32(SvgHitMask::AlphaThreshold);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 bias = _mm_set1_ps(kReciprocalBias);
+    const __m128i even24 = _mm_set_epi32(0, 0x00FFFFFF, 0, 0x00FFFFFF);
+    const __m128i odd24 = _mm_set_epi32(0x00FFFFFF, 0, 0x00FFFFFF, 0);
+
+    int x = 0;
+    // each block of 4 pixels writes 2 scratch bytes past its 12 RGB bytes,
+    // so stop while at least one more pixel follows to overwrite them
+    for (; x + 5 <= width; x += 4)
+    {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+        const __m128i a = _mm_srli_epi32(v, 24);
+        const __m128i transparent = _mm_cmpeq_epi32(a, zero);
+        const __m128 rcp = _mm_mul_ps(_mm_div_ps(one, _mm_cvtepi32_ps(a)), bias);
+
+        const __m128i b = UnpremultiplySSE2(_mm_and_si128(v, lo8), rcp, transparent, lo8);
+        const __m128i g = UnpremultiplySSE2(_mm_and_si128(_mm_srli_epi32(v, 8), lo8), rcp, transparent, lo8);
+        const __m128i r = UnpremultiplySSE2(_mm_and_si128(_mm_srli_epi32(v, 16), lo8), rcp, transparent, lo8);
+
+        // one R,G,B,0 word per pixel; squeeze each 64-bit pair down to 6 bytes
+        const __m128i px = _mm_or_si128(r, _mm_or_si128(_mm_slli_epi32(g, 8), _mm_slli_epi32(b, 16)));
+        const __m128i packed = _mm_or_si128(_mm_and_si128(px, even24),
+                                            _mm_srli_epi64(_mm_and_si128(px, odd24), 8));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(rgb + x * 3), packed);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(rgb + x * 3 + 6), _mm_srli_si128(packed, 8));
+
+        const __m128i a16 = _mm_packs_epi32(a, a);
+        const int a4 = _mm_cvtsi128_si32(_mm_packus_epi16(a16, a16));
+        std::memcpy(alpha + x, &a4, 4);
+
+        if (maskRow)
+        {
+            const int bits = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(a, threshold)));
+            maskRow[x >> 5] |= static_cast<uint32_t>(bits) << (x & 31);
+        }
+    }
+    return x;
+}
+
+SVG_TARGET_AVX2 inline __m256i UnpremultiplyAVX2(__m256i c, __m256 rcp, __m256i transparent, __m256i lo8)
+{
+    __m256i n = _mm256_sub_epi32(_mm256_slli_epi32(c, 8), c);             // c * 255
+    __m256i q = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(n), rcp));
+    q = _mm256_and_si256(q, lo8);                                         // unsigned char wrap
+    return _mm256_blendv_epi8(q, c, transparent);
+}
+
+SVG_TARGET_AVX2 int ConvertRowAVX2(const unsigned char* src, unsigned char* rgb, unsigned char* alpha,
+                                   uint32_t* maskRow, int width)
+{
+    const __m256i lo8 = _mm256_set1_epi32(0xFF);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i threshold = _mm256_set1_epi32(SvgHitMask::AlphaThreshold);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 bias = _mm256_set1_ps(kReciprocalBias);
+    // per 128-bit lane: 4 R,G,B,0 words -> 12 packed bytes; 4 BGRA pixels -> 4 alpha bytes
+    const __m256i rgbShuffle = _mm256_setr_epi8(
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const __m256i alphaShuffle = _mm256_setr_epi8(
+        3, 7, 11, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        3, 7, 11, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+
+    int x = 0;
+    // each block of 8 pixels writes 4 scratch bytes past its 24 RGB bytes,
+    // so stop while at least two more pixels follow to overwrite them
+    for (; x + 10 <= width; x += 8)
+    {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x * 4));
+        const __m256i a = _mm256_srli_epi32(v, 24);
+        const __m256i transparent = _mm256_cmpeq_epi32(a, zero);
+        const __m256 rcp = _mm256_mul_ps(_mm256_div_ps(one, _mm256_cvtepi32_ps(a)), bias);
+
+        const __m256i b = UnpremultiplyAVX2(_mm256_and_si256(v, lo8), rcp, transparent, lo8);
+        const __m256i g = UnpremultiplyAVX2(_mm256_and_si256(_mm256_srli_epi32(v, 8), lo8), rcp, transparent, lo8);
+        const __m256i r = UnpremultiplyAVX2(_mm256_and_si256(_mm256_srli_epi32(v, 16), lo8), rcp, transparent, lo8);
+
+        const __m256i px = _mm256_or_si256(r, _mm256_or_si256(_mm256_slli_epi32(g, 8), _mm256_slli_epi32(b, 16)));
+        const __m256i packed = _mm256_shuffle_epi8(px, rgbShuffle);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(rgb + x * 3), _mm256_castsi256_si128(packed));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(rgb + x * 3 + 12), _mm256_extracti128_si256(packed, 1));
+
+        const __m256i av = _mm256_shuffle_epi8(v, alphaShuffle);
+        const int a0 = _mm_cvtsi128_si32(_mm256_castsi256_si128(av));
+        const int a1 = _mm_cvtsi128_si32(_mm256_extracti128_si256(av, 1));
+        std::memcpy(alpha + x, &a0, 4);
+        std::memcpy(alpha + x + 4, &a1, 4);
+
+        if (maskRow)
+        {
+            const int bits = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(a, threshold)));
+            maskRow[x >> 5] |= static_cast<uint32_t>(bits) << (x & 31);
+        }
+    }
+    return x;
+}
+
+// 32-bit destination pixels: every lane of a register is one whole pixel, so
+// channels are placed by shifting. Returns the first pixel left for the scalar tail.
+SVG_TARGET_SSE2 int PixelRowSSE2(const unsigned char* src, unsigned char* dst, uint32_t* maskRow, int width,
+                                 const SvgPixelConvert::PixelLayout& layout)
+{
+    const __m128i lo8 = _mm_set1_epi32(0xFF);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i threshold = _mm_set1_epi32(SvgHitMask::AlphaThreshold);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 bias = _mm_set1_ps(kReciprocalBias);
+    const __m128i redShift = _mm_cvtsi32_si128(layout.red * 8);
+    const __m128i greenShift = _mm_cvtsi32_si128(layout.green * 8);
+    const __m128i blueShift = _mm_cvtsi32_si128(layout.blue * 8);
+    const __m128i alphaShift = _mm_cvtsi32_si128(layout.alpha * 8);
+
+    int x = 0;
+    for (; x + 4 <= width; x += 4)
+    {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+        const __m128i a = _mm_srli_epi32(v, 24);
+        __m128i b = _mm_and_si128(v, lo8);
+        __m128i g = _mm_and_si128(_mm_srli_epi32(v, 8), lo8);
+        __m128i r = _mm_and_si128(_mm_srli_epi32(v, 16), lo8);
+        if (!layout.premultiplied)
+        {
+            const __m128i transparent = _mm_cmpeq_epi32(a, zero);
+            const __m128 rcp = _mm_mul_ps(_mm_div_ps(one, _mm_cvtepi32_ps(a)), bias);
+            b = UnpremultiplySSE2(b, rcp, transparent, lo8);
+            g = UnpremultiplySSE2(g, rcp, transparent, lo8);
+            r = UnpremultiplySSE2(r, rcp, transparent, lo8);
+        }
+
+        const __m128i px = _mm_or_si128(_mm_or_si128(_mm_sll_epi32(r, redShift), _mm_sll_epi32(g, greenShift)),
+                                        _mm_or_si128(_mm_sll_epi32(b, blueShift), _mm_sll_epi32(a, alphaShift)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), px);
+
+        if (maskRow)
+        {
+            // x is a multiple of 4, so the four bits never straddle two words
+            const int bits = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(a, threshold)));
+            maskRow[x >> 5] |= static_cast<uint32_t>(bits) << (x & 31);
+        }
+    }
+    return x;
+}
+
+bool CpuHasAVX2()
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#else
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#endif
+}
+
+bool CpuHasSSE2()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    return true; // baseline on x86-64
+#elif defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2") != 0;
+#else
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#endif
+}
+
+#endif // SVG_CONVERT_X86
+
+} // namespace
+
+SvgPixelConvert::Kernel SvgPixelConvert::GetBestKernel()
+{
+    static const Kernel best = IsSupported(AVX2) ? AVX2 : IsSupported(SSE2) ? SSE2 : Scalar;
+    return best;
+}
+
+bool SvgPixelConvert::IsSupported(Kernel kernel)
+{
+    switch (kernel)
+    {
+    case Auto:
+    case Scalar:
+        return true;
+#ifdef SVG_CONVERT_X86
+    case SSE2:
+        return CpuHasSSE2();
+    case AVX2:
+        return CpuHasAVX2();
+#endif
+    default:
+        return false;
+    }
+}
+
+const char* SvgPixelConvert::GetKernelName(Kernel kernel)
+{
+    switch (kernel)
+    {
+    case Auto:   return GetKernelName(GetBestKernel());
+    case Scalar: return "scalar";
+    case SSE2:   return "sse2";
+    case AVX2:   return "avx2";
+    }
+    return "unknown";
+}
+
+void SvgPixelConvert::BgraToPixelRow(const unsigned char* src, int width, unsigned char* dst,
+                                     const PixelLayout& layout, uint32_t* maskRow)
+{
+    int x = 0;
+#ifdef SVG_CONVERT_X86
+    if (GetBestKernel() != Scalar)
+        x = PixelRowSSE2(src, dst, maskRow, width, layout);
+#endif
+
+    const uint32_t* rcp = GetReciprocals();
+    for (src += x * 4, dst += x * 4; x < width; ++x, src += 4, dst += 4)
+    {
+        uint32_t b = src[0];
+        uint32_t g = src[1];
+        uint32_t r = src[2];
+        const uint32_t a = src[3];
+        if (!layout.premultiplied && a != 0)
+        {
+            const uint32_t k = rcp[a];
+            r = (r * k) >> 16;
+            g = (g * k) >> 16;
+            b = (b * k) >> 16;
+        }
+
+        dst[layout.red] = static_cast<unsigned char>(r);
+        dst[layout.green] = static_cast<unsigned char>(g);
+        dst[layout.blue] = static_cast<unsigned char>(b);
+        dst[layout.alpha] = static_cast<unsigned char>(a);
+        if (maskRow && a > SvgHitMask::AlphaThreshold)
+            maskRow[x >> 5] |= 1u << (x & 31);
+    }
+}
+
+void SvgPixelConvert::BgraToRgbAlpha(const unsigned char* src, int stride, int width, int height,
+                                     unsigned char* rgb, unsigned char* alpha,
+                                     SvgHitMask* mask, Kernel kernel)
+{
+    if (kernel == Auto || !IsSupported(kernel))
+        kernel = GetBestKernel();
+
+    for (int y = 0; y < height; ++y)
+    {
+        const unsigned char* row = src + static_cast<ptrdiff_t>(y) * stride;
+        unsigned char* rgbRow = rgb + static_cast<ptrdiff_t>(y) * width * 3;
+        unsigned char* alphaRow = alpha + static_cast<ptrdiff_t>(y) * width;
+        uint32_t* maskRow = mask ? mask->GetRowBits(y) : nullptr;
+
+        int x = 0;
+#ifdef SVG_CONVERT_X86
+        if (kernel == AVX2)
+            x = ConvertRowAVX2(row, rgbRow, alphaRow, maskRow, width);
+        else if (kernel == SSE2)
+            x = ConvertRowSSE2(row, rgbRow, alphaRow, maskRow, width);
+#endif
+        ConvertRowScalar(row, rgbRow, alphaRow, maskRow, x, width);
+    }
+}
@@ -0,0 +1,179 @@
+#include "svg_profiler.h"
+
+#include <cstdio>
+
+// Names of the frame figures in the trace's counter tracks
+static const char* const CounterNames[SvgProfiler::CounterCount] =
+{
+    "rendered", "blitted", "culled", "cache_hits", "cache_misses"
+};
+static const char* const TimingNames[SvgProfiler::TimingCount] =
+{
+    nullptr, "rasterize", "convert"
+};
+
+SvgProfiler& SvgProfiler::Get()
+{
+    static SvgProfiler profiler;
+    return profiler;
+}
+
+SvgProfiler::SvgProfiler()
+    : m_enabled(false)
+    , m_tracing(false)
+    , m_epoch(std::chrono::steady_clock::now())
+    , m_frameOpen(false)
+    , m_frame(0)
+    , m_lastFrame()
+{
+    for (auto& count : m_counts)
+        count = 0;
+    for (int i = 0; i < TimingCount; ++i)
+    {
+        m_timed[i] = 0;
+        m_timedNs[i] = 0;
+    }
+}
+
+void SvgProfiler::SetEnabled(bool enabled)
+{
+    if (enabled == IsEnabled())
+        return;
+
+    // Start from a clean frame rather than with counts from the last time
+    for (auto& count : m_counts)
+        count = 0;
+    for (int i = 0; i < TimingCount; ++i)
+    {
+        m_timed[i] = 0;
+        m_timedNs[i] = 0;
+    }
+    m_enabled = enabled;
+    if (!enabled)
+        m_tracing = false;
+}
+
+void SvgProfiler::StartTrace()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_events.clear();
+        m_frames.clear();
+    }
+    SetEnabled(true);
+    m_tracing = true;
+}
+
+bool SvgProfiler::WriteTrace(const std::string& path) const
+{
+    std::vector<Event> events;
+    std::vector<FrameEvent> frames;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        events = m_events;
+        frames = m_frames;
+    }
+
+    FILE* fp = fopen(path.c_str(), "w");
+    if (!fp)
+        return false;
+
+    // Complete events ("X") for scopes, counter events ("C") for frame figures
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"svg_canvas\"}}");
+    for (const Event& e : events)
+    {
+        fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"svg\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lld,\"dur\":%lld",
+                e.name, e.thread, e.startUs, e.durationUs);
+        if (e.width > 0)
+            fprintf(fp, ",\"args\":{\"width\":%d,\"height\":%d}", e.width, e.height);
+        fprintf(fp, "}");
+    }
+    for (const FrameEvent& f : frames)
+    {
+        fprintf(fp, ",\n{\"name\":\"items\",\"ph\":\"C\",\"pid\":1,\"ts\":%lld,\"args\":{", f.startUs);
+        for (int i = 0; i < CounterCount; ++i)
+            fprintf(fp, "%s\"%s\":%u", i ? "," : "", CounterNames[i], f.stats.counts[i]);
+        fprintf(fp, "}}");
+        fprintf(fp, ",\n{\"name\":\"frame_ms\",\"ph\":\"C\",\"pid\":1,\"ts\":%lld,\"args\":{\"paint\":%.3f",
+                f.startUs, f.stats.paintMs);
+        for (int i = NoTiming + 1; i < TimingCount; ++i)
+            fprintf(fp, ",\"%s\":%.3f", TimingNames[i], f.stats.timedMs[i]);
+        fprintf(fp, "}}");
+    }
+    fprintf(fp, "\n]}\n");
+    return fclose(fp) == 0;
+}
+
+void SvgProfiler::BeginFrame()
+{
+    m_frameOpen = IsEnabled();
+    if (m_frameOpen)
+        m_frameStart = std::chrono::steady_clock::now();
+}
+
+void SvgProfiler::EndFrame()
+{
+    if (!m_frameOpen || !IsEnabled())
+        return;
+    m_frameOpen = false;
+
+    const auto end = std::chrono::steady_clock::now();
+    FrameStats stats;
+    stats.frame = ++m_frame;
+    stats.paintMs = std::chrono::duration<double, std::milli>(end - m_frameStart).count();
+    for (int i = 0; i < CounterCount; ++i)
+        stats.counts[i] = m_counts[i].exchange(0, std::memory_order_relaxed);
+    for (int i = 0; i < TimingCount; ++i)
+    {
+        stats.timed[i] = m_timed[i].exchange(0, std::memory_order_relaxed);
+        stats.timedMs[i] = m_timedNs[i].exchange(0, std::memory_order_relaxed) / 1e6;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_lastFrame = stats;
+    if (IsTracing() && m_events.size() + m_frames.size() < MaxTraceEvents)
+    {
+        m_events.push_back(Event{ "paint", Microseconds(m_frameStart), Microseconds(end) - Microseconds(m_frameStart),
+                                  GetThreadIndex(), 0, 0 });
+        m_frames.push_back(FrameEvent{ Microseconds(m_frameStart), stats });
+    }
+}
+
+SvgProfiler::FrameStats SvgProfiler::GetLastFrame() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_lastFrame;
+}
+
+void SvgProfiler::EndScope(const char* name, Timing timing, std::chrono::steady_clock::time_point start,
+                           int width, int height)
+{
+    const auto end = std::chrono::steady_clock::now();
+    if (timing != NoTiming)
+    {
+        m_timed[timing].fetch_add(1, std::memory_order_relaxed);
+        m_timedNs[timing].fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(),
+                                    std::memory_order_relaxed);
+    }
+
+    if (!IsTracing())
+        return;
+
+    const Event event{ name, Microseconds(start), Microseconds(end) - Microseconds(start), GetThreadIndex(), width, height };
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_events.size() + m_frames.size() < MaxTraceEvents)
+        m_events.push_back(event);
+}
+
+long long SvgProfiler::Microseconds(std::chrono::steady_clock::time_point time) const
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(time - m_epoch).count();
+}
+
+unsigned SvgProfiler::GetThreadIndex()
+{
+    static std::atomic<unsigned> next(0);
+    thread_local const unsigned index = ++next;
+    return index;
+}
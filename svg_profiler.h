@@ -0,0 +1,156 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Process-wide instrumentation of paint, hit testing, parsing and rendering.
+// Keeps per-frame figures (paint time, items rendered / blitted / culled, bitmap
+// cache hits and misses, rasterization and conversion time) for the canvas
+// overlay, and while a trace is recorded, every timed scope as Chrome trace-event
+// JSON, to open in chrome://tracing or Perfetto.
+//
+// Off by default. While off, a hook costs one relaxed atomic load and a branch,
+// so it stays compiled into release builds. Thread-safe: rasterization and
+// parsing are timed on worker threads too.
+class SvgProfiler
+{
+public:
+    enum { MaxTraceEvents = 1 << 20 }; // a trace stops growing past this many events
+
+    // Figures counted between two frames
+    enum Counter
+    {
+        Rendered,    // items rasterized during the paint, or queued for a worker
+        Blitted,     // items drawn from an existing bitmap (cache, atlas)
+        Culled,      // items outside the painted area, or hidden
+        CacheHits,   // bitmap cache lookups answered with the exact render
+        CacheMisses,
+        CounterCount
+    };
+
+    // Timed scopes added up per frame
+    enum Timing
+    {
+        NoTiming,
+        Rasterize,   // lunasvg drawing into a pixel buffer
+        Convert,     // those pixels into a wxImage or native bitmap
+        TimingCount
+    };
+
+    struct FrameStats
+    {
+        unsigned long long frame;  // index since profiling was enabled, 0 if none yet
+        double paintMs;
+        unsigned counts[CounterCount];
+        unsigned timed[TimingCount];   // scopes that ended, on any thread
+        double timedMs[TimingCount];   // their total
+    };
+
+    static SvgProfiler& Get();
+
+    bool IsEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+    void SetEnabled(bool enabled);
+
+    // Record trace events from now on (enabling the profiler), until StopTrace().
+    // The recorded trace is kept until the next StartTrace(); WriteTrace() saves
+    // it as JSON, false if the file could not be written.
+    void StartTrace();
+    void StopTrace() { m_tracing = false; }
+    bool WriteTrace(const std::string& path) const;
+    bool IsTracing() const { return m_tracing.load(std::memory_order_relaxed); }
+
+    // A painted frame: counts and timings from now on belong to it. EndFrame()
+    // closes it; GetLastFrame() then returns its figures. UI thread.
+    void BeginFrame();
+    void EndFrame();
+    FrameStats GetLastFrame() const;
+
+    void Count(Counter counter, unsigned n = 1)
+    {
+        if (IsEnabled())
+            m_counts[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    // Time elapsed since 'start' as one trace event named 'name' (a literal: only
+    // the pointer is kept), adding it to 'timing' of the current frame
+    void EndScope(const char* name, Timing timing, std::chrono::steady_clock::time_point start,
+                  int width = 0, int height = 0);
+
+private:
+    struct Event
+    {
+        const char* name;
+        long long startUs;   // since m_epoch
+        long long durationUs;
+        unsigned thread;
+        int width;           // of the render, 0 if not a render
+        int height;
+    };
+
+    struct FrameEvent
+    {
+        long long startUs;
+        FrameStats stats;
+    };
+
+    SvgProfiler();
+
+    long long Microseconds(std::chrono::steady_clock::time_point time) const;
+    static unsigned GetThreadIndex(); // small, stable per thread, for the trace
+
+private:
+    std::atomic<bool> m_enabled;
+    std::atomic<bool> m_tracing;
+    const std::chrono::steady_clock::time_point m_epoch;
+
+    // Current frame, written by every thread
+    std::atomic<unsigned> m_counts[CounterCount];
+    std::atomic<unsigned> m_timed[TimingCount];
+    std::atomic<unsigned long long> m_timedNs[TimingCount];
+
+    // UI thread only
+    std::chrono::steady_clock::time_point m_frameStart;
+    bool m_frameOpen;   // BeginFrame() ran while enabled
+    unsigned long long m_frame;
+    FrameStats m_lastFrame;
+
+    mutable std::mutex m_mutex;         // guards the trace and m_lastFrame copies
+    std::vector<Event> m_events;
+    std::vector<FrameEvent> m_frames;
+};
+
+// Times its scope into SvgProfiler; does nothing while profiling is off
+class SvgProfileScope
+{
+public:
+    explicit SvgProfileScope(const char* name, SvgProfiler::Timing timing = SvgProfiler::NoTiming,
+                             int width = 0, int height = 0)
+        : m_name(SvgProfiler::Get().IsEnabled() ? name : nullptr)
+        , m_timing(timing)
+        , m_width(width)
+        , m_height(height)
+    {
+        if (m_name)
+            m_start = std::chrono::steady_clock::now();
+    }
+
+    ~SvgProfileScope()
+    {
+        if (m_name)
+            SvgProfiler::Get().EndScope(m_name, m_timing, m_start, m_width, m_height);
+    }
+
+    SvgProfileScope(const SvgProfileScope&) = delete;
+    SvgProfileScope& operator=(const SvgProfileScope&) = delete;
+
+private:
+    const char* m_name;
+    SvgProfiler::Timing m_timing;
+    int m_width;
+    int m_height;
+    std::chrono::steady_clock::time_point m_start;
+};
@@ -0,0 +1,165 @@
+#include "svg_render_buffer.h"
+
+#include <utility>
+
+SvgRenderBufferPool::Lease::Lease(Lease&& other) noexcept
+    : m_pool(other.m_pool)
+    , m_data(other.m_data)
+    , m_size(other.m_size)
+{
+    other.m_pool = nullptr;
+    other.m_data = nullptr;
+    other.m_size = 0;
+}
+
+SvgRenderBufferPool::Lease& SvgRenderBufferPool::Lease::operator=(Lease&& other) noexcept
+{
+    if (this != &other)
+    {
+        Release();
+        std::swap(m_pool, other.m_pool);
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+    }
+    return *this;
+}
+
+void SvgRenderBufferPool::Lease::Release()
+{
+    if (m_data)
+        m_pool->Return(m_data, m_size);
+    m_pool = nullptr;
+    m_data = nullptr;
+    m_size = 0;
+}
+
+SvgRenderBufferPool& SvgRenderBufferPool::Get()
+{
+    static SvgRenderBufferPool pool;
+    return pool;
+}
+
+SvgRenderBufferPool::SvgRenderBufferPool()
+    : m_budget(size_t(DefaultBudgetMB) << 20)
+    , m_stats()
+{
+}
+
+SvgRenderBufferPool::~SvgRenderBufferPool()
+{
+    FreeIdle(0);
+}
+
+size_t SvgRenderBufferPool::GetClassSize(size_t bytes)
+{
+    if (bytes <= MinBlockSize)
+        return MinBlockSize;
+
+    // Quarter steps between powers of two: 1, 1.25, 1.5, 1.75 times 2^k
+    size_t octave = MinBlockSize;
+    while (octave * 2 < bytes)
+        octave *= 2;
+    const size_t step = octave / 4;
+    return (bytes + step - 1) / step * step;
+}
+
+SvgRenderBufferPool::Lease SvgRenderBufferPool::Acquire(size_t bytes)
+{
+    const size_t size = GetClassSize(bytes);
+    unsigned char* data = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_stats.acquires;
+        auto found = m_idle.find(size);
+        if (found != m_idle.end() && !found->second.empty())
+        {
+            data = found->second.back();
+            found->second.pop_back();
+            m_stats.idleBytes -= size;
+        }
+        else
+            ++m_stats.allocations;
+        m_stats.leasedBytes += size;
+    }
+
+    if (!data)
+        data = new unsigned char[size];
+
+    Lease lease;
+    lease.m_pool = this;
+    lease.m_data = data;
+    lease.m_size = size;
+    return lease;
+}
+
+void SvgRenderBufferPool::Return(unsigned char* data, size_t size)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.leasedBytes -= size;
+        if (m_stats.idleBytes + size <= m_budget)
+        {
+            m_idle[size].push_back(data);
+            m_stats.idleBytes += size;
+            return;
+        }
+        ++m_stats.frees;
+    }
+    delete[] data;
+}
+
+void SvgRenderBufferPool::SetBudget(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_budget = bytes;
+    FreeIdle(bytes);
+}
+
+size_t SvgRenderBufferPool::GetBudget() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_budget;
+}
+
+void SvgRenderBufferPool::Trim()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    FreeIdle(0);
+}
+
+SvgRenderBufferPool::Stats SvgRenderBufferPool::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void SvgRenderBufferPool::FreeIdle(size_t keepBytes)
+{
+    // Largest blocks first: they are the rarest sizes and free the most
+    while (m_stats.idleBytes > keepBytes)
+    {
+        auto largest = m_idle.end();
+        for (auto it = m_idle.begin(); it != m_idle.end(); ++it)
+        {
+            if (!it->second.empty() && (largest == m_idle.end() || it->first > largest->first))
+                largest = it;
+        }
+        if (largest == m_idle.end())
+            break;
+
+        delete[] largest->second.back();
+        largest->second.pop_back();
+        m_stats.idleBytes -= largest->first;
+        ++m_stats.frees;
+    }
+}
+
+SvgRenderBuffer::SvgRenderBuffer(int width, int height)
+{
+    if (width <= 0 || height <= 0)
+        return;
+
+    m_lease = SvgRenderBufferPool::Get().Acquire(static_cast<size_t>(width) * height * 4);
+    m_bitmap = lunasvg::Bitmap(m_lease.GetData(), width, height, width * 4);
+    m_bitmap.clear(0x00000000);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "lunasvg.h"
+
+// Process-wide pool of pixel memory for rasterizing and converting renders.
+// Blocks come in size classes, four per power of two (at most a fifth of a block
+// unused), and go back to the pool instead of being freed, so a zoom gesture that
+// renders hundreds of items at a handful of sizes only allocates on its first
+// frames. Idle blocks are kept up to the budget; past it, returned blocks are freed.
+// Thread-safe: workers and the UI thread share it, and a block may be returned on
+// another thread than the one that took it.
+class SvgRenderBufferPool
+{
+public:
+    enum { DefaultBudgetMB = 64 };
+    enum { MinBlockSize = 4096 };
+
+    struct Stats
+    {
+        unsigned long long acquires;    // blocks handed out
+        unsigned long long allocations; // of those, newly allocated; the rest were reused
+        unsigned long long frees;       // blocks freed: returned over budget, or Trim()
+        size_t idleBytes;               // kept for reuse
+        size_t leasedBytes;             // handed out now
+    };
+
+    // Hold on one block; returns it to the pool when released or destroyed
+    class Lease
+    {
+    public:
+        Lease() : m_pool(nullptr), m_data(nullptr), m_size(0) {}
+        Lease(Lease&& other) noexcept;
+        Lease& operator=(Lease&& other) noexcept;
+        ~Lease() { Release(); }
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        bool IsOk() const { return m_data != nullptr; }
+        unsigned char* GetData() const { return m_data; }
+        size_t GetSize() const { return m_size; } // of the size class, at least what was asked for
+        void Release();
+
+    private:
+        friend class SvgRenderBufferPool;
+        SvgRenderBufferPool* m_pool;
+        unsigned char* m_data;
+        size_t m_size;
+    };
+
+    static SvgRenderBufferPool& Get();
+
+    // Uninitialized block of at least 'bytes'
+    Lease Acquire(size_t bytes);
+
+    void SetBudget(size_t bytes); // of idle blocks; 0 keeps none
+    size_t GetBudget() const;
+    void Trim();                  // free every idle block
+
+    Stats GetStats() const;
+
+private:
+    SvgRenderBufferPool();
+    ~SvgRenderBufferPool();
+
+    static size_t GetClassSize(size_t bytes);
+    void Return(unsigned char* data, size_t size);
+    void FreeIdle(size_t keepBytes); // caller holds m_mutex
+
+private:
+    mutable std::mutex m_mutex;
+    std::unordered_map<size_t, std::vector<unsigned char*>> m_idle; // by class size
+    size_t m_budget;
+    Stats m_stats;
+};
+
+// A lunasvg bitmap drawing into pooled memory, cleared to transparent. The memory
+// goes back to the pool with the buffer. Move-only.
+class SvgRenderBuffer
+{
+public:
+    SvgRenderBuffer() {}
+    SvgRenderBuffer(int width, int height);
+
+    bool IsOk() const { return m_lease.IsOk(); }
+    lunasvg::Bitmap& GetBitmap() { return m_bitmap; }
+    const lunasvg::Bitmap& GetBitmap() const { return m_bitmap; }
+
+private:
+    SvgRenderBufferPool::Lease m_lease;
+    lunasvg::Bitmap m_bitmap; // wraps the lease's memory; declared after it, so destroyed first
+};
@@ -0,0 +1,237 @@
+#include "svg_scene_snapshot.h"
+#include "svg_mapped_file.h"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const char HeaderMagic[8] = { 'S', 'V', 'G', 'S', 'C', 'E', 'N', 'E' };
+    const char TrailerMagic[8] = { 'S', 'V', 'G', 'S', 'C', 'E', 'N', 'D' };
+    const uint32_t FormatVersion = 1;
+
+    enum { ItemVisible = 1 };
+
+    class Writer
+    {
+    public:
+        explicit Writer(std::ostream& out) : m_out(out) {}
+
+        void Bytes(const void* data, size_t size) { m_out.write(static_cast<const char*>(data), size); }
+
+        void U32(uint32_t value)
+        {
+            const unsigned char bytes[4] = { (unsigned char)value, (unsigned char)(value >> 8),
+                                             (unsigned char)(value >> 16), (unsigned char)(value >> 24) };
+            Bytes(bytes, 4);
+        }
+        void I32(int value) { U32(static_cast<uint32_t>(value)); }
+        void U8(unsigned value) { const unsigned char byte = (unsigned char)value; Bytes(&byte, 1); }
+
+        void String(const std::string& text)
+        {
+            U32(static_cast<uint32_t>(text.size()));
+            Bytes(text.data(), text.size());
+        }
+
+    private:
+        std::ostream& m_out;
+    };
+
+    // Bounds-checked cursor over the whole file; any overrun clears ok
+    class Reader
+    {
+    public:
+        Reader(const char* data, size_t size) : m_pos(data), m_end(data + size), m_ok(true) {}
+
+        bool IsOk() const { return m_ok; }
+        void Fail() { m_ok = false; }
+        size_t GetRemaining() const { return m_ok ? static_cast<size_t>(m_end - m_pos) : 0; }
+
+        const char* Bytes(size_t size)
+        {
+            if (!m_ok || size > GetRemaining())
+            {
+                m_ok = false;
+                return nullptr;
+            }
+            const char* data = m_pos;
+            m_pos += size;
+            return data;
+        }
+
+        uint32_t U32()
+        {
+            const unsigned char* b = reinterpret_cast<const unsigned char*>(Bytes(4));
+            return b ? b[0] | (b[1] << 8) | (b[2] << 16) | (uint32_t(b[3]) << 24) : 0;
+        }
+        int I32() { return static_cast<int>(U32()); }
+        unsigned U8() { const char* b = Bytes(1); return b ? static_cast<unsigned char>(*b) : 0; }
+
+        void String(std::string& text)
+        {
+            const uint32_t size = U32();
+            const char* data = Bytes(size);
+            if (data)
+                text.assign(data, size);
+        }
+
+        // A count of records at least minSize bytes each; rejects counts the rest
+        // of the file cannot hold before anything is allocated for them
+        uint32_t Count(size_t minSize)
+        {
+            const uint32_t count = U32();
+            if (m_ok && count > GetRemaining() / minSize)
+                m_ok = false;
+            return m_ok ? count : 0;
+        }
+
+    private:
+        const char* m_pos;
+        const char* m_end;
+        bool m_ok;
+    };
+}
+
+void SvgSceneSnapshot::Clear()
+{
+    sources.clear();
+    documents.clear();
+    items.clear();
+}
+
+bool SvgSceneSnapshot::Save(const std::string& filePath) const
+{
+    // Written next to the target and renamed over it, so a failed save keeps the old scene
+    fs::path temp(filePath);
+    temp += ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+
+        Writer w(out);
+        w.Bytes(HeaderMagic, sizeof(HeaderMagic));
+        w.U32(FormatVersion);
+
+        w.U32(static_cast<uint32_t>(sources.size()));
+        for (const Source& source : sources)
+        {
+            w.String(source.path);
+            w.String(source.text ? *source.text : std::string());
+        }
+
+        w.U32(static_cast<uint32_t>(documents.size()));
+        for (const Document& doc : documents)
+        {
+            w.U32(doc.source);
+            w.U32(static_cast<uint32_t>(doc.edits.size()));
+            for (const SvgDomEdit& edit : doc.edits)
+            {
+                w.U8(edit.kind);
+                w.String(edit.selector);
+                w.U32(edit.index);
+                w.String(edit.name);
+                w.String(edit.value);
+            }
+        }
+
+        w.U32(static_cast<uint32_t>(items.size()));
+        for (const Item& item : items)
+        {
+            w.I32(item.x);
+            w.I32(item.y);
+            w.I32(item.width);
+            w.I32(item.height);
+            w.U8(item.visible ? ItemVisible : 0);
+            w.String(item.label);
+            w.U32(item.document);
+        }
+
+        w.Bytes(TrailerMagic, sizeof(TrailerMagic));
+        out.close();
+        if (!out)
+        {
+            std::error_code ec;
+            fs::remove(temp, ec);
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(temp, filePath, ec);
+    if (ec)
+        fs::remove(temp, ec);
+    return !ec;
+}
+
+bool SvgSceneSnapshot::Load(const std::string& filePath)
+{
+    Clear();
+
+    SvgMappedFile file;
+    if (!file.Open(filePath))
+        return false;
+
+    Reader r(file.GetData(), file.GetSize());
+    const char* magic = r.Bytes(sizeof(HeaderMagic));
+    if (!magic || memcmp(magic, HeaderMagic, sizeof(HeaderMagic)) != 0 || r.U32() != FormatVersion)
+        return false;
+
+    // Smallest encodings: a source is two empty strings, a document two 32-bit
+    // fields, an edit a byte, three empty strings and an index, an item 25 bytes
+    sources.resize(r.Count(8));
+    for (Source& source : sources)
+    {
+        r.String(source.path);
+        auto text = std::make_shared<std::string>();
+        r.String(*text);
+        source.text = text;
+    }
+
+    documents.resize(r.Count(8));
+    for (Document& doc : documents)
+    {
+        doc.source = r.U32();
+        doc.edits.resize(r.Count(17));
+        for (SvgDomEdit& edit : doc.edits)
+        {
+            const unsigned kind = r.U8();
+            edit.kind = static_cast<SvgDomEdit::Kind>(kind);
+            r.String(edit.selector);
+            edit.index = r.U32();
+            r.String(edit.name);
+            r.String(edit.value);
+            if (kind > SvgDomEdit::ApplyStyleSheet)
+                r.Fail(); // written by a newer version
+        }
+        if (doc.source >= sources.size())
+            r.Fail();
+    }
+
+    items.resize(r.Count(25));
+    for (Item& item : items)
+    {
+        item.x = r.I32();
+        item.y = r.I32();
+        item.width = r.I32();
+        item.height = r.I32();
+        item.visible = (r.U8() & ItemVisible) != 0;
+        r.String(item.label);
+        item.document = r.U32();
+        if (item.document >= documents.size())
+            r.Fail();
+    }
+
+    const char* trailer = r.Bytes(sizeof(TrailerMagic));
+    if (!r.IsOk() || memcmp(trailer, TrailerMagic, sizeof(TrailerMagic)) != 0 || r.GetRemaining() != 0)
+    {
+        Clear();
+        return false;
+    }
+    return true;
+}
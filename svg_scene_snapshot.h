@@ -0,0 +1,58 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "svg_document_store.h"
+
+// A canvas scene in a compact binary file. Sources are stored once however
+// many items show them; documents pair a source with the DOM edits recorded
+// on it; items reference a document.
+//
+// The file is written front to back in one pass and read the same way:
+//   header   "SVGSCENE", format version
+//   sources  count, then per source: path, text
+//   documents count, then per document: source index, edits
+//   items    count, then per item: position, base size, flags, label, document index
+//   trailer  "SVGSCEND"
+// Integers are little-endian, strings are a 32-bit length followed by the bytes
+// (labels in UTF-8). Reading checks every length and index, so a truncated or
+// corrupt file is rejected instead of producing a partial scene.
+class SvgSceneSnapshot
+{
+public:
+    struct Source
+    {
+        std::shared_ptr<const std::string> text;
+        std::string path; // file the source was loaded from, if any
+    };
+
+    struct Document
+    {
+        unsigned source;
+        std::vector<SvgDomEdit> edits;
+    };
+
+    struct Item
+    {
+        int x;
+        int y;
+        int width;        // base size, before zoom
+        int height;
+        bool visible;
+        std::string label; // UTF-8
+        unsigned document;
+    };
+
+    std::vector<Source> sources;
+    std::vector<Document> documents;
+    std::vector<Item> items; // in paint order
+
+    bool Save(const std::string& filePath) const;
+
+    // Replaces the contents; on failure the snapshot is left empty
+    bool Load(const std::string& filePath);
+
+    void Clear();
+};
@@ -0,0 +1,157 @@
+#include "svg_spatial_grid.h"
+
+#include <algorithm>
+
+// floor division so negative coordinates land in the right cell
+static int FloorDiv(int v, int d)
+{
+    return v >= 0 ? v / d : -((-v + d - 1) / d);
+}
+
+SvgSpatialGrid::SvgSpatialGrid(int cellSize)
+    : m_cellSize(std::max(16, cellSize))
+    , m_stamp(0)
+{
+}
+
+void SvgSpatialGrid::CellRange(const wxRect& r, int& cx0, int& cy0, int& cx1, int& cy1) const
+{
+    cx0 = FloorDiv(r.x, m_cellSize);
+    cy0 = FloorDiv(r.y, m_cellSize);
+    cx1 = FloorDiv(r.x + std::max(r.width, 1) - 1, m_cellSize);
+    cy1 = FloorDiv(r.y + std::max(r.height, 1) - 1, m_cellSize);
+}
+
+void SvgSpatialGrid::Link(Entry* entry)
+{
+    int cx0, cy0, cx1, cy1;
+    CellRange(entry->bounds, cx0, cy0, cx1, cy1);
+    for (int cy = cy0; cy <= cy1; ++cy)
+        for (int cx = cx0; cx <= cx1; ++cx)
+            m_cells[CellKey(cx, cy)].push_back(entry);
+}
+
+void SvgSpatialGrid::Unlink(Entry* entry)
+{
+    int cx0, cy0, cx1, cy1;
+    CellRange(entry->bounds, cx0, cy0, cx1, cy1);
+    for (int cy = cy0; cy <= cy1; ++cy)
+    {
+        for (int cx = cx0; cx <= cx1; ++cx)
+        {
+            auto cell = m_cells.find(CellKey(cx, cy));
+            if (cell == m_cells.end())
+                continue;
+
+            auto& v = cell->second;
+            auto it = std::find(v.begin(), v.end(), entry);
+            if (it != v.end())
+            {
+                *it = v.back();
+                v.pop_back();
+            }
+            if (v.empty())
+                m_cells.erase(cell);
+        }
+    }
+}
+
+void SvgSpatialGrid::Update(uint32_t slot, const wxRect& bounds)
+{
+    auto it = m_entries.find(slot);
+    if (it != m_entries.end())
+    {
+        Entry& entry = it->second;
+        if (entry.bounds == bounds)
+            return;
+
+        // Only relink when the covered cells actually change
+        int ox0, oy0, ox1, oy1, nx0, ny0, nx1, ny1;
+        CellRange(entry.bounds, ox0, oy0, ox1, oy1);
+        CellRange(bounds, nx0, ny0, nx1, ny1);
+        if (ox0 == nx0 && oy0 == ny0 && ox1 == nx1 && oy1 == ny1)
+        {
+            entry.bounds = bounds;
+            return;
+        }
+
+        Unlink(&entry);
+        entry.bounds = bounds;
+        Link(&entry);
+        return;
+    }
+
+    Entry& entry = m_entries[slot];
+    entry.slot = slot;
+    entry.bounds = bounds;
+    entry.stamp = m_stamp;
+    Link(&entry);
+}
+
+void SvgSpatialGrid::Remove(uint32_t slot)
+{
+    auto it = m_entries.find(slot);
+    if (it == m_entries.end())
+        return;
+
+    Unlink(&it->second);
+    m_entries.erase(it);
+}
+
+void SvgSpatialGrid::Clear()
+{
+    m_cells.clear();
+    m_entries.clear();
+}
+
+void SvgSpatialGrid::Query(const wxRect& area, std::vector<uint32_t>& out) const
+{
+    const unsigned stamp = ++m_stamp;
+
+    auto visit = [&](const std::vector<Entry*>& cell)
+    {
+        for (const Entry* e : cell)
+        {
+            if (e->stamp == stamp)
+                continue;
+            e->stamp = stamp;
+            if (e->bounds.Intersects(area))
+                out.push_back(e->slot);
+        }
+    };
+
+    int cx0, cy0, cx1, cy1;
+    CellRange(area, cx0, cy0, cx1, cy1);
+
+    // A huge area (e.g. zoomed far out) covers more cells than exist: walk the occupied ones
+    const long long spanned = static_cast<long long>(cx1 - cx0 + 1) * (cy1 - cy0 + 1);
+    if (spanned > static_cast<long long>(m_cells.size()))
+    {
+        for (const auto& cell : m_cells)
+            visit(cell.second);
+        return;
+    }
+
+    for (int cy = cy0; cy <= cy1; ++cy)
+    {
+        for (int cx = cx0; cx <= cx1; ++cx)
+        {
+            auto cell = m_cells.find(CellKey(cx, cy));
+            if (cell != m_cells.end())
+                visit(cell->second);
+        }
+    }
+}
+
+void SvgSpatialGrid::Query(const wxPoint& pt, std::vector<uint32_t>& out) const
+{
+    auto cell = m_cells.find(CellKey(FloorDiv(pt.x, m_cellSize), FloorDiv(pt.y, m_cellSize)));
+    if (cell == m_cells.end())
+        return;
+
+    for (const Entry* e : cell->second)
+    {
+        if (e->bounds.Contains(pt))
+            out.push_back(e->slot);
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <wx/gdicmn.h>
+
+// Uniform grid over item bounds (canvas coordinates), used to cull paint and
+// hit-test work to the items near a rectangle or point. Items are identified by
+// their SvgItemStore slot, and reported once per query, in no particular order.
+class SvgSpatialGrid
+{
+public:
+    explicit SvgSpatialGrid(int cellSize = 256);
+
+    // Insert the item, or move it if it is already indexed.
+    void Update(uint32_t slot, const wxRect& bounds);
+    void Remove(uint32_t slot);
+    void Clear();
+
+    // Append items whose indexed bounds intersect 'area' / contain 'pt'.
+    void Query(const wxRect& area, std::vector<uint32_t>& out) const;
+    void Query(const wxPoint& pt, std::vector<uint32_t>& out) const;
+
+    size_t GetCount() const { return m_entries.size(); }
+
+private:
+    struct Entry
+    {
+        uint32_t slot;
+        wxRect bounds;
+        mutable unsigned stamp; // last query that reported this entry
+    };
+
+    // Both halves as unsigned bit patterns: shifting a negative cx would be undefined
+    static uint64_t CellKey(int cx, int cy)
+    {
+        return static_cast<uint64_t>(static_cast<uint32_t>(cx)) << 32 | static_cast<uint32_t>(cy);
+    }
+
+    void CellRange(const wxRect& r, int& cx0, int& cy0, int& cx1, int& cy1) const;
+    void Link(Entry* entry);
+    void Unlink(Entry* entry);
+
+private:
+    int m_cellSize;
+    std::unordered_map<uint32_t, Entry> m_entries;           // node-based: Entry* stays valid
+    std::unordered_map<uint64_t, std::vector<Entry*>> m_cells;
+    mutable unsigned m_stamp;
+};
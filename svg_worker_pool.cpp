@@ -0,0 +1,82 @@
+#include "svg_worker_pool.h"
+
+#include <algorithm>
+
+SvgWorkerPool::SvgWorkerPool(unsigned threadCount)
+    : m_stopping(false)
+{
+    if (threadCount == 0)
+    {
+        unsigned hw = std::thread::hardware_concurrency();
+        threadCount = hw > 1 ? hw - 1 : 1;
+    }
+
+    m_threads.reserve(threadCount);
+    for (unsigned i = 0; i < threadCount; ++i)
+        m_threads.emplace_back(&SvgWorkerPool::WorkerLoop, this);
+}
+
+SvgWorkerPool::~SvgWorkerPool()
+{
+    Shutdown();
+}
+
+void SvgWorkerPool::Submit(Task task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopping)
+            return;
+        m_queue.push_back(std::move(task));
+    }
+    m_cond.notify_one();
+}
+
+size_t SvgWorkerPool::CancelPending()
+{
+    std::deque<Task> dropped;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        dropped.swap(m_queue);
+    }
+    // tasks are destroyed outside the lock
+    return dropped.size();
+}
+
+void SvgWorkerPool::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopping && m_threads.empty())
+            return;
+        m_stopping = true;
+        m_queue.clear();
+    }
+    m_cond.notify_all();
+
+    for (auto& t : m_threads)
+    {
+        if (t.joinable())
+            t.join();
+    }
+    m_threads.clear();
+}
+
+void SvgWorkerPool::WorkerLoop()
+{
+    for (;;)
+    {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+            if (m_stopping)
+                return;
+
+            task = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+
+        task();
+    }
+}
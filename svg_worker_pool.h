@@ -0,0 +1,46 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small fixed-size thread pool used to keep rasterization off the UI thread.
+// Tasks must not touch wx GUI objects; they hand their results back to the
+// UI thread themselves (e.g. through wxEvtHandler::CallAfter).
+class SvgWorkerPool
+{
+public:
+    using Task = std::function<void()>;
+
+    // threadCount == 0 -> one less than the number of hardware threads (at least 1)
+    explicit SvgWorkerPool(unsigned threadCount = 0);
+    ~SvgWorkerPool();
+
+    SvgWorkerPool(const SvgWorkerPool&) = delete;
+    SvgWorkerPool& operator=(const SvgWorkerPool&) = delete;
+
+    // Queue a task; tasks are started in FIFO order on any free worker.
+    void Submit(Task task);
+
+    // Drop queued tasks that have not started yet. Running tasks are not interrupted.
+    // Returns the number of dropped tasks.
+    size_t CancelPending();
+
+    // Cancel pending work and join all workers. Safe to call more than once.
+    void Shutdown();
+
+    unsigned GetThreadCount() const { return static_cast<unsigned>(m_threads.size()); }
+
+private:
+    void WorkerLoop();
+
+private:
+    std::vector<std::thread> m_threads;
+    std::deque<Task> m_queue;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_stopping;
+};